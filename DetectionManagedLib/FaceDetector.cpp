@@ -14,6 +14,7 @@ namespace DetectionManagedLib
 		const char *pszName = (const char *)(Marshal::StringToHGlobalAnsi(strFileName)).ToPointer();
 
 		_pDetector = new DETECTOR (pszName);
+		_pWorkspace = new DETWORKSPACE ();
 
 		_pDetector->SetReject(fPrune);
 
@@ -28,6 +29,10 @@ namespace DetectionManagedLib
 		{
 			delete _pDetector;
 		}
+		if (_pWorkspace != NULL)
+		{
+			delete _pWorkspace;
+		}
 	}
 
 	DetectionResult ^ FaceDetector::DetectObject (const char *pszName)
@@ -148,22 +153,15 @@ namespace DetectionManagedLib
 
 		DetectionResult ^ detectionResult = gcnew DetectionResult(_iSignature, scaleFac);
 
-		// create & integral image
-		IN_IMAGE *piimg = new IN_IMAGE ();
-		if (!piimg)
-		{
-			free (pimg);
-			return nullptr;
-		}
-
-		piimg->Init (pimg);
+		// integral image, its buffers are kept from the previous call
+		_pWorkspace->GetIImage()->Init (pimg);
 
 		// run detector
 		DateTime tmStart = DateTime::Now;
 
 		// set the threshold to the minimum so that we get "all the possible" raw rectangles
 		_pDetector->SetFinalScoreTh(_eMinThresh);
-		_pDetector->DetectObject (piimg);
+		_pDetector->DetectObject (_pWorkspace);
 
 		detectionResult->tmDetection = DateTime::Now - tmStart;
 
@@ -171,7 +169,7 @@ namespace DetectionManagedLib
 		SCORED_RECT *prect;
 
 		// get raw rectangles
-		int cRect = _pDetector->GetDetResults(&prect, false);
+		int cRect = _pWorkspace->GetDetResults(&prect, false);
 
 		// get the raw rectangles
 		for (int iRect = 0; iRect < cRect; iRect++)
@@ -179,7 +177,6 @@ namespace DetectionManagedLib
 			detectionResult->AddRawRect (gcnew ScoredRect(prect + iRect, ScoredRect::RectType::Raw));
 		}
 
-		delete piimg;
 		delete pScaledImage;
 
 		return detectionResult;
@@ -215,43 +212,14 @@ namespace DetectionManagedLib
 			return NULL;
 		}
 
+		// area average over whole scaleFac x scaleFac blocks, leftover columns and rows are dropped
+		// so that the detections still map back by multiplying with scaleFac
 		int iNewWidth = pInImage->GetWidth() / scaleFac;
 		int iNewHeight = pInImage->GetHeight() / scaleFac;
-		int iNewStride = pInImage->GetStride() / scaleFac;
+		IRECT srcRect(0, iNewWidth * scaleFac, 0, iNewHeight * scaleFac);
 
-		if (iNewWidth * scaleFac != pInImage->GetWidth() ||
-			iNewHeight * scaleFac != pInImage->GetHeight() ||
-			iNewStride * scaleFac != pInImage->GetStride())
-		{
-			return NULL;
-		}
-
-		BYTE	*pNewBuf = new BYTE[iNewHeight * iNewStride];
-		int		iPix = 0;
-		int		iStride =  pInImage->GetStride();
-		int		scaleFac2 = scaleFac * scaleFac;
-		BYTE	*pInBuf = pInImage->GetDataPtr();
-
-		for (int iRow = 0 ; iRow < pInImage->GetHeight() ; iRow += scaleFac)
-		{
-			for (int iCol = 0 ; iCol < pInImage->GetWidth() ; iCol += scaleFac)
-			{
-				int pixVal = 0;
-
-				for (int j = 0 ; j < scaleFac ; ++j)
-				{
-					BYTE *pLine = pInBuf + (iRow + j)* iStride + iCol;
-
-					for (int i = 0 ; i< scaleFac ; ++i)
-					{
-						pixVal += pLine[i];
-					}
-				}
-				pNewBuf[iPix++] = (BYTE)(pixVal/scaleFac2);
-			}
-		}
-
-		IMAGE *pRet = new IMAGE(iNewWidth, iNewHeight, iNewStride, pNewBuf);
+		IMAGE *pRet = new IMAGE();
+		pInImage->ResampleToImage(pRet, iNewWidth, iNewHeight, &srcRect);
 
 		return pRet;
 	}
@@ -269,20 +237,6 @@ namespace DetectionManagedLib
 
 		scaleFac = min(xScale, yScale);
 
-		if (scaleFac <= 0 )
-		{
-			return scaleFac;
-		}
-
-		for ( ; scaleFac > 1 ; --scaleFac)
-		{
-			if (actualWidth / scaleFac * scaleFac == actualWidth &&
-				actualHeight / scaleFac * scaleFac == actualHeight )
-			{
-				break;
-			}
-		}
-
 		return scaleFac;
 	}
 	// Return Bytes per pixels, only for formats that use 8 bits per colour plane
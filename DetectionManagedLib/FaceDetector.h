@@ -43,6 +43,7 @@ public:
 private:
 	bool _fPrune;
 	DETECTOR *_pDetector;
+	DETWORKSPACE *_pWorkspace;	// integral image and result lists, reused across calls
 	float _eMinThresh;
 	float _eDefaultThreshold;
 	int	_targetWidth;
@@ -2,6 +2,7 @@
 #include "classifier.h"
 #include "image.h"
 #include "imageinfo.h"
+#include "imgloader.h"
 
 using namespace std; 
 
@@ -264,15 +265,18 @@ void ResetTh()
 
     // do the actual detection work 
     vector<IMGINFO *>::iterator it; 
-    IMAGE image; 
-    IN_IMAGE iimage; 
+    vector<const char *> FileNameVec; 
+    for (it=ImgInfoVec.begin(); it!=ImgInfoVec.end(); it++) 
+        FileNameVec.push_back((*it)->m_szFileName); 
+    // the images are read and decoded in the background while the current one is scanned 
+    IMAGELOADER loader(FileNameVec.empty() ? NULL : &FileNameVec[0], (int)FileNameVec.size(), LOADER_IIMAGE); 
     int k, num=0, nActualNumPosObjs = 0; 
     for (it=ImgInfoVec.begin(); it!=ImgInfoVec.end(); it++,num++) 
     {
         IMGINFO *pInfo = *it; 
-        // load the images 
-        image.Load(pInfo->m_szFileName); 
-        iimage.Init(&image); 
+        // get the prefetched integral image 
+        loader.Next(); 
+        IN_IMAGE &iimage = *loader.GetIImage(); 
 
         for (int i=0; i<pInfo->m_nNumObj; i++) 
         {
@@ -282,9 +286,9 @@ void ResetTh()
             {
                 CLASSIFIER *pC = ClassifierArray[m]; 
                 IRECT rect (0, nWidth[m], 0, nHeight[m]); 
-                while (rect.m_iyMax <= image.GetHeight()) 
+                while (rect.m_iyMax <= pInfo->m_nImgHeight) 
                 {
-                    while (rect.m_ixMax <= image.GetWidth()) 
+                    while (rect.m_ixMax <= pInfo->m_nImgWidth) 
                     {
 #if METHOD == DIRECT_BACKWARD_PRUNE
                         if (rect.DetectMatchTight(pInfo->m_pObjRcs[i],0.1,1.25))
@@ -466,15 +470,18 @@ void ResetTh_SCP()
 
     // do the actual detection work 
     vector<IMGINFO *>::iterator it; 
-    IMAGE image; 
-    IN_IMAGE iimage; 
+    vector<const char *> FileNameVec; 
+    for (it=ImgInfoVec.begin(); it!=ImgInfoVec.end(); it++) 
+        FileNameVec.push_back((*it)->m_szFileName); 
+    // the images are read and decoded in the background while the current one is scanned 
+    IMAGELOADER loader(FileNameVec.empty() ? NULL : &FileNameVec[0], (int)FileNameVec.size(), LOADER_IIMAGE); 
     int k, num=0, nActualNumPosObjs = 0, nActualNumRects = 0; 
     for (it=ImgInfoVec.begin(); it!=ImgInfoVec.end(); it++,num++) 
     {
         IMGINFO *pInfo = *it; 
-        // load the images 
-        image.Load(pInfo->m_szFileName); 
-        iimage.Init(&image); 
+        // get the prefetched integral image 
+        loader.Next(); 
+        IN_IMAGE &iimage = *loader.GetIImage(); 
 
         for (int i=0; i<pInfo->m_nNumObj; i++) 
         {
@@ -484,9 +491,9 @@ void ResetTh_SCP()
             {
                 CLASSIFIER *pC = ClassifierArray[m]; 
                 IRECT rect (0, nWidth[m], 0, nHeight[m]); 
-                while (rect.m_iyMax <= image.GetHeight()) 
+                while (rect.m_iyMax <= pInfo->m_nImgHeight) 
                 {
-                    while (rect.m_ixMax <= image.GetWidth()) 
+                    while (rect.m_ixMax <= pInfo->m_nImgWidth) 
                     {
                         if (rect.DetectMatchTight(pInfo->m_pObjRcs[i],0.1,1.25))
                         {
@@ -609,7 +616,7 @@ void ResetTh_SCP()
             {
                 if (pfRankScore[j] < pfRankScore[j+1]) 
                 {
-                    th = max(pfRankScore[j+1]-epslon, (pfRankScore[j]+pfRankScore[j+1]/2.0)); 
+                    th = (float)max((double)(pfRankScore[j+1]-epslon), (pfRankScore[j]+pfRankScore[j+1]/2.0)); 
                     break; 
                 }
             }
@@ -679,15 +686,18 @@ void CreateScoreTraces()
 
     // do the actual detection work 
     vector<IMGINFO *>::iterator it; 
-    IMAGE image; 
-    IN_IMAGE iimage; 
+    vector<const char *> FileNameVec; 
+    for (it=ImgInfoVec.begin(); it!=ImgInfoVec.end(); it++) 
+        FileNameVec.push_back((*it)->m_szFileName); 
+    // the images are read and decoded in the background while the current one is scanned 
+    IMAGELOADER loader(FileNameVec.empty() ? NULL : &FileNameVec[0], (int)FileNameVec.size(), LOADER_IIMAGE); 
     int k, num=0, nActualNumPosObjs = 0; 
     for (it=ImgInfoVec.begin(); it!=ImgInfoVec.end(); it++,num++) 
     {
         IMGINFO *pInfo = *it; 
-        // load the images 
-        image.Load(pInfo->m_szFileName); 
-        iimage.Init(&image); 
+        // get the prefetched integral image 
+        loader.Next(); 
+        IN_IMAGE &iimage = *loader.GetIImage(); 
 
         for (int i=0; i<pInfo->m_nNumObj; i++) 
         {
@@ -696,9 +706,9 @@ void CreateScoreTraces()
             {
                 CLASSIFIER *pC = ClassifierArray[m]; 
                 IRECT rect (0, nWidth[m], 0, nHeight[m]); 
-                while (rect.m_iyMax <= image.GetHeight()) 
+                while (rect.m_iyMax <= pInfo->m_nImgHeight) 
                 {
-                    while (rect.m_ixMax <= image.GetWidth()) 
+                    while (rect.m_ixMax <= pInfo->m_nImgWidth) 
                     {
                         float score = 0.0f; 
                         float norm = iimage.ComputeNorm(&rect); 
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "detector.h"
 #include "imageinfo.h"
+#include "detpipeline.h"
 
 using namespace std; 
 
@@ -9,6 +10,7 @@ using namespace std;
 #define DRAW_MERGED_RECTS
 //#define DRAW_FALSE_POS_RECTS
 //#define DRAW_FALSE_NEG_RECTS
+#define SHARED_LOOKUP_STAGES    40      // classifiers compiled to share integral lookups
 
 char szClassifierFile[MAX_PATH]; 
 float fStepSize; 
@@ -17,6 +19,8 @@ vector<IMGINFO *> ImgInfoVec;
 
 char szResultFile[MAX_PATH]; 
 bool bOutputResult = false;
+char szCacheFile[MAX_PATH]; 
+bool bUseCache = false; 
 
 void Usage()
 {
@@ -25,10 +29,12 @@ void Usage()
         "Tool for testing a given face detector with a set of images.\n"
         "\n"
         "\n"
-        "FaceDetTestImages fileName [resultName]\n"
+        "FaceDetTestImages fileName [resultName [cacheName]]\n"
         "\n"
         "    fileName      -- name of a test configuration file\n"
         "    resultName    -- name of the result file listing all detected faces\n"
+        "    cacheName     -- result cache file, near duplicates of the images in it\n"
+        "                     are not scanned again. created if missing, updated at the end\n"
         "\n";
 
     printf("%s\n", msg);
@@ -110,151 +116,174 @@ bool LoadTestFile(const char *szTestFile)
     return bRetVal; 
 }
 
-void TestImages()
+// state shared with the pipeline callback 
+struct TESTCONTEXT
 {
-//    float totalTime; 
-//    LONGLONG PerformanceCountBegin=0,PerformanceCountEnd=0, PeformanceCounterFrequency;
-//    ::QueryPerformanceCounter((LARGE_INTEGER*)&PerformanceCountBegin);
-    DETECTOR detector (szClassifierFile, fStepSize, fStepScale); 
-//    ::QueryPerformanceCounter((LARGE_INTEGER*)&PerformanceCountEnd);
-//    ::QueryPerformanceFrequency( (LARGE_INTEGER*)&PeformanceCounterFrequency);
-//    totalTime = (PerformanceCountEnd-PerformanceCountBegin)/(float)PeformanceCounterFrequency;
-//    printf ("Initialize detector takes %f second\n", totalTime); 
-
-    vector<IMGINFO *>::iterator it; 
-    IMAGE image; 
-    IN_IMAGE iimage; 
-
-    FILE *fp = NULL; 
-    if (bOutputResult) 
+    FILE *fp; 
+    int count; 
+    int fnCount; 
+    int fpCount; 
+}; 
+
+// called for every image in list order, on one thread at a time 
+bool OnDetResult(const DETRESULT *pResult, void *pContext)
+{
+    TESTCONTEXT *pCtx = (TESTCONTEXT *)pContext; 
+    IMGINFO *pInfo = ImgInfoVec[pResult->m_nIndex]; 
+    if (pResult->m_szError) 
     {
-        fp = fopen(szResultFile, "w"); 
-        if (fp == NULL) 
-        {
-            throw "null file";
-            return; 
-        }
+        printf ("%s: %s\n", pInfo->m_szFileName, pResult->m_szError); 
+        return true; 
     }
+    IMAGE &image = *pResult->m_pImage; 
+    int num; 
+    SCORED_RECT *pRc; 
 
-    int count = 0, num; 
-    int fnCount = 0, fpCount = 0; 
-    for (it=ImgInfoVec.begin(); it!=ImgInfoVec.end(); it++) 
-    {
-        IMGINFO *pInfo = *it; 
-        // load the images 
-        image.Load(pInfo->m_szFileName); 
-        float totalTime; 
-        LONGLONG PerformanceCountBegin=0,PerformanceCountEnd=0, PeformanceCounterFrequency;
-        //::QueryPerformanceCounter((LARGE_INTEGER*)&PerformanceCountBegin);
-        iimage.Init(&image); 
-	    //::QueryPerformanceCounter((LARGE_INTEGER*)&PerformanceCountEnd);
-	    //::QueryPerformanceFrequency( (LARGE_INTEGER*)&PeformanceCounterFrequency);
-        //totalTime = (PerformanceCountEnd-PerformanceCountBegin)/(float)PeformanceCounterFrequency;
-        //printf ("Construct iimage time on %s (%dx%d): %f second\n", pInfo->m_szFileName, 
-        //                                                     image.GetWidth(), 
-        //                                                     image.GetHeight(), 
-        //                                                     totalTime); 
-
-        //PerformanceCountBegin=0,PerformanceCountEnd=0;
-        //::QueryPerformanceCounter((LARGE_INTEGER*)&PerformanceCountBegin);
-        detector.DetectObject(&iimage); 
-	    //::QueryPerformanceCounter((LARGE_INTEGER*)&PerformanceCountEnd);
-	    //::QueryPerformanceFrequency( (LARGE_INTEGER*)&PeformanceCounterFrequency);
-        //totalTime = (PerformanceCountEnd-PerformanceCountBegin)/(float)PeformanceCounterFrequency;
-        //printf ("Detection time on %s (%dx%d): %f second\n", pInfo->m_szFileName, 
-        //                                                  image.GetWidth(), 
-        //                                                  image.GetHeight(), 
-        //                                                  totalTime); 
-
-        SCORED_RECT *pRc; 
-
-        // get the raw detected rectangles 
+    // get the raw detected rectangles 
 #if defined (DRAW_RAW_RECTS)
-        num = detector.GetDetResults(&pRc, false); 
-        for (int i=0; i<num; i++) 
-            image.DrawRectAlpha(&pRc[i].m_rect, 0.1f); 
+    num = pResult->m_nNumRawRect; 
+    pRc = pResult->m_pRawRect; 
+    for (int i=0; i<num; i++) 
+        image.DrawRectAlpha(&pRc[i].m_rect, 0.1f); 
 #endif
 
 
-        // draw the ground truth rectangle
+    // draw the ground truth rectangle
 #if defined(DRAW_GT_RECTS)
-        for (int i=0; i<pInfo->m_nNumObj; i++) 
-            image.DrawRect(&pInfo->m_pObjRcs[i], 0); 
+    for (int i=0; i<pInfo->m_nNumObj; i++) 
+        image.DrawRect(&pInfo->m_pObjRcs[i], 0); 
 #endif
 
-        num = detector.GetDetResults(&pRc, true); 
-        if (bOutputResult)
-        {
-            fprintf(fp, "%s\n%d\n", pInfo->m_szFileName, num); 
-            for (int i=0; i<num; i++)
-                fprintf(fp, "%d %d %d %d\n", pRc[i].m_rect.m_ixMin, pRc[i].m_rect.m_iyMin, pRc[i].m_rect.m_ixMax, pRc[i].m_rect.m_iyMax);
-        }
-        // draw the merged rectangle 
+    num = pResult->m_nNumMergedRect; 
+    pRc = pResult->m_pMergedRect; 
+    if (pCtx->fp)
+    {
+        fprintf(pCtx->fp, "%s\n%d\n", pInfo->m_szFileName, num); 
+        for (int i=0; i<num; i++)
+            fprintf(pCtx->fp, "%d %d %d %d\n", pRc[i].m_rect.m_ixMin, pRc[i].m_rect.m_iyMin, pRc[i].m_rect.m_ixMax, pRc[i].m_rect.m_iyMax);
+    }
+    // draw the merged rectangle 
 #if defined(DRAW_MERGED_RECTS) 
-        for (int i=0; i<num; i++) 
-            image.DrawRect(&pRc[i].m_rect, 255); 
+    for (int i=0; i<num; i++) 
+        image.DrawRect(&pRc[i].m_rect, 255); 
 #endif
 
 #if defined(DRAW_FALSE_NEG_RECTS)
-        for (int j=0; j<pInfo->m_nNumObj; j++) 
+    for (int j=0; j<pInfo->m_nNumObj; j++) 
+    {
+        bool bFN = true; 
+        for (int i=0; i<num; i++) 
         {
-            bool bFN = true; 
-            for (int i=0; i<num; i++) 
+            if (pRc[i].m_rect.DetectMatchDetection(pInfo->m_pObjRcs[j])) 
             {
-                if (pRc[i].m_rect.DetectMatchDetection(pInfo->m_pObjRcs[j])) 
-                {
-                    bFN = false; 
-                    break; 
-                }
-            }
-            if (bFN) 
-            {
-                image.DrawRect(&pInfo->m_pObjRcs[j], 0); 
-                fnCount ++; 
+                bFN = false; 
+                break; 
             }
         }
+        if (bFN) 
+        {
+            image.DrawRect(&pInfo->m_pObjRcs[j], 0); 
+            pCtx->fnCount ++; 
+        }
+    }
 #endif 
 
 #if defined(DRAW_FALSE_POS_RECTS)
-        for (int i=0; i<num; i++) 
+    for (int i=0; i<num; i++) 
+    {
+        bool bFP = true; 
+        for (int j=0; j<pInfo->m_nNumObj; j++) 
         {
-            bool bFP = true; 
-            for (int j=0; j<pInfo->m_nNumObj; j++) 
-            {
-                if (pRc[i].m_rect.DetectMatchDetection(pInfo->m_pObjRcs[j])) 
-                {
-                    bFP = false; 
-                    break; 
-                }
-            }
-            if (bFP) 
+            if (pRc[i].m_rect.DetectMatchDetection(pInfo->m_pObjRcs[j])) 
             {
-                image.DrawRect(&pRc[i].m_rect, 255); 
-                fpCount ++; 
+                bFP = false; 
+                break; 
             }
         }
+        if (bFP) 
+        {
+            image.DrawRect(&pRc[i].m_rect, 255); 
+            pCtx->fpCount ++; 
+        }
+    }
 #endif 
 
 
-        char fname[MAX_PATH]; 
-        int len = (int)strlen(pInfo->m_szFileName); 
-        strcpy(fname, pInfo->m_szFileName); 
-        strcpy(&fname[len-4], "_det.jpg"); 
-//        image.Save(fname); 
-        count ++; 
-        if (count%50 == 0) 
-            printf ("."); 
-        if (count%1000 == 0) 
-            printf ("%d images are processed\r", count); 
+    char fname[MAX_PATH]; 
+    int len = (int)strlen(pInfo->m_szFileName); 
+    strcpy(fname, pInfo->m_szFileName); 
+    strcpy(&fname[len-4], "_det.jpg"); 
+//    image.Save(fname); 
+    pCtx->count ++; 
+    if (pCtx->count%50 == 0) 
+        printf ("."); 
+    if (pCtx->count%1000 == 0) 
+        printf ("%d images are processed\r", pCtx->count); 
+    return true; 
+}
+
+void TestImages()
+{
+//    float totalTime; 
+//    LONGLONG PerformanceCountBegin=0,PerformanceCountEnd=0, PeformanceCounterFrequency;
+//    ::QueryPerformanceCounter((LARGE_INTEGER*)&PerformanceCountBegin);
+    DETECTOR detector (szClassifierFile, fStepSize, fStepScale); 
+    detector.SetSharedLookupStages(SHARED_LOOKUP_STAGES); 
+//    ::QueryPerformanceCounter((LARGE_INTEGER*)&PerformanceCountEnd);
+//    ::QueryPerformanceFrequency( (LARGE_INTEGER*)&PeformanceCounterFrequency);
+//    totalTime = (PerformanceCountEnd-PerformanceCountBegin)/(float)PeformanceCounterFrequency;
+//    printf ("Initialize detector takes %f second\n", totalTime); 
+
+    vector<IMGINFO *>::iterator it; 
+    vector<const char *> FileNameVec; 
+    for (it=ImgInfoVec.begin(); it!=ImgInfoVec.end(); it++) 
+        FileNameVec.push_back((*it)->m_szFileName); 
+
+    TESTCONTEXT ctx; 
+    ctx.fp = NULL; 
+    ctx.count = 0; 
+    ctx.fnCount = 0; 
+    ctx.fpCount = 0; 
+    if (bOutputResult) 
+    {
+        ctx.fp = fopen(szResultFile, "w"); 
+        if (ctx.fp == NULL) 
+        {
+            throw "null file";
+            return; 
+        }
+    }
+
+    // decoding, integral images, scanning and merging of different images overlap, 
+    // the results still come back in list order 
+    DETPIPELINE pipeline(&detector); 
+    DETCACHE cache; 
+    if (bUseCache) 
+    {
+        FILE *fpCache = fopen(szCacheFile, "r"); 
+        if (fpCache) 
+        {
+            fclose(fpCache); 
+            cache.Load(szCacheFile); 
+        }
+        pipeline.SetResultCache(&cache); 
+    }
+    FILELISTSOURCE source(FileNameVec.empty() ? NULL : &FileNameVec[0], (int)FileNameVec.size()); 
+    pipeline.Run(&source, OnDetResult, &ctx); 
+    printf ("Totally %d images are processed\n", ctx.count); 
+    if (bUseCache) 
+    {
+        printf ("Result cache: %d hits, %d misses, %d images cached\n", 
+                cache.GetHits(), cache.GetMisses(), cache.GetCount()); 
+        cache.Save(szCacheFile); 
     }
-    printf ("Totally %d images are processed\n", count); 
 
     if (bOutputResult)
-        fclose(fp); 
+        fclose(ctx.fp); 
 
 #if defined(DRAW_FALSE_NEG_RECTS) && defined(DRAW_FALSE_POS_RECTS)
-    printf("Total false negative examples: %d\n", fnCount); 
-    printf("Total false positive examples: %d\n", fpCount); 
+    printf("Total false negative examples: %d\n", ctx.fnCount); 
+    printf("Total false positive examples: %d\n", ctx.fpCount); 
 #endif
 
 #if defined(COUNT_PRUNE_EFFECT)
@@ -266,6 +295,21 @@ void TestImages()
     for (int i=0; i<detector.GetNumClassifiers(); i++) 
         avgNode += double(i+1)*pPruneCount[i]/total; 
     printf ("Average number of nodes visited with pruning: %lf\n", avgNode); 
+
+    // a window pruned at classifier i has read the integral for classifiers 0..i. the scan 
+    // only reads through the shared lookups when the dense stages are off 
+    bool bShared = detector.GetSharedLookupStages() > 0 && 
+                   (detector.GetDenseStages() == 0 || detector.GetMaxSkip() > 0); 
+    double avgLookups = 0.0, avgScanLookups = 0.0; 
+    __int64 reached = total; 
+    for (int i=0; i<detector.GetNumClassifiers(); i++) 
+    {
+        avgLookups += double(reached)*detector.GetLookups(i, false)/total; 
+        avgScanLookups += double(reached)*detector.GetLookups(i, bShared)/total; 
+        reached -= pPruneCount[i]; 
+    }
+    printf ("Average number of integral lookups per window: %lf without sharing, %lf done by the scan (%d classifiers shared)\n", 
+            avgLookups, avgScanLookups, bShared ? detector.GetSharedLookupStages() : 0); 
 #endif
 
     ReleaseImgInfoVec(); 
@@ -273,17 +317,22 @@ void TestImages()
 
 int main(int argc, char* argv[])
 {
-    if (argc != 2 && argc != 3) 
+    if (argc < 2 || argc > 4) 
     {
         Usage(); 
         return -1; 
     }
 
-    if (argc == 3) 
+    if (argc >= 3) 
     {
         strcpy(szResultFile, argv[2]); 
         bOutputResult = true; 
     }
+    if (argc == 4) 
+    {
+        strcpy(szCacheFile, argv[3]); 
+        bUseCache = true; 
+    }
 
     LoadTestFile(argv[1]); 
 
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "imageinfo.h"
 #include "detector.h" 
+#include "imgloader.h"
 
 using namespace std; 
 
@@ -10,6 +11,12 @@ float fStepScale;
 int nNumTh; 
 float *pfTh; 
 bool bFast; 
+int nMaxSkip = 0; 
+float fSkipMargin = DEFAULT_SKIP_MARGIN; 
+bool bSkipRows = false; 
+char *szCalibratedFile = NULL; 
+int nNumCuts = 0; 
+int *pnCuts = NULL; 
 vector<IMGINFO *> ImgInfoVec; 
 
 void Usage()
@@ -19,12 +26,21 @@ void Usage()
         "Tool for generating ROC curves for a given face detector.\n"
         "\n"
         "\n"
-        "FaceDetTestROC fileName minTh maxTh stepTh rej\n"
+        "FaceDetTestROC fileName minTh maxTh stepTh [maxSkip [margin [rows]]]\n"
+        "FaceDetTestROC fileName minTh maxTh stepTh -calibrate newClassifier numStages ...\n"
         "\n"
         "    fileName      -- name of a test configuration file\n"
         "    minTh         -- minimum threshold to try\n" 
         "    maxTh         -- maximum threshold to try\n" 
         "    stepTh        -- stepsize of the threshold\n"
+        "    maxSkip       -- also run with the adaptive step and report the recall\n"
+        "                     lost, see DETECTOR::SetAdaptiveStep()\n"
+        "    margin        -- score shortfall per skipped window (default 0.375)\n"
+        "    rows          -- 1 to skip down the columns too (default 0)\n"
+        "    -calibrate    -- run the cascade cut after each numStages classifiers and\n"
+        "                     pick the final threshold giving the detection rate of the\n"
+        "                     whole cascade, newClassifier receives the model with them,\n"
+        "                     see DETECTOR::GetTruncScoreTh()\n"
         "\n";
 
     printf("%s\n", msg);
@@ -120,25 +136,41 @@ bool LoadTestFile(const char *szTestFile)
     return bRetVal; 
 }
 
-void ComputeROC()
+// one pass over the test set, pDetRate receives the detection rate of each threshold. 
+// numStages cuts the cascade, 0 for the whole one. returns the number of windows scanned 
+double ComputeROC(int maxSkip, int numStages, double *pDetRate, int *pIdxStart)
 {
     DETECTOR detector (szClassifierFile, fStepSize, fStepScale, 5000000); 
     detector.SetFinalScoreTh(pfTh[0]); 
+    detector.SetAdaptiveStep(maxSkip, fSkipMargin, bSkipRows); 
+    if (numStages > 0 && numStages < detector.GetNumClassifiers()) 
+        detector.SetTruncScoreTh(numStages, pfTh[0]); 
+    detector.SetNumStages(numStages); 
+    double totalWindows = 0.0; 
 
     // do the actual detection work 
     vector<IMGINFO *>::iterator it; 
-    IMAGE image; 
-    IN_IMAGE iimage; 
+    vector<const char *> FileNameVec; 
+    for (it=ImgInfoVec.begin(); it!=ImgInfoVec.end(); it++) 
+    {
+        IMGINFO *pInfo = *it; 
+        FileNameVec.push_back(pInfo->m_szFileName); 
+        memset(pInfo->m_nNumDetectedPos, 0, nNumTh*sizeof(int)); 
+        memset(pInfo->m_nNumFPos, 0, nNumTh*sizeof(int)); 
+        if (pInfo->m_nNumObj > 0) 
+            memset(pInfo->m_bDetected, 0, nNumTh*pInfo->m_nNumObj*sizeof(bool)); 
+    }
+    // the images are read and decoded in the background while the current one is scanned 
+    IMAGELOADER loader(FileNameVec.empty() ? NULL : &FileNameVec[0], (int)FileNameVec.size(), LOADER_IIMAGE); 
     int num = 0; 
     int idxStart = 0; 
     for (it=ImgInfoVec.begin(); it!=ImgInfoVec.end(); it++, num++) 
     {
         IMGINFO *pInfo = *it; 
-        // load the images 
-        image.Load(pInfo->m_szFileName); 
-        iimage.Init(&image); 
-
-        detector.DetectObject(&iimage); 
+        // get the prefetched integral image, the gray image itself is not needed here 
+        loader.Next(); 
+        detector.DetectObject(loader.GetIImage()); 
+        totalWindows += detector.GetTotalWindows(); 
         SCORED_RECT *pRc; 
 
         // get the raw detected rectangles 
@@ -196,7 +228,7 @@ void ComputeROC()
 
     // now collect the statistics 
     printf ("Threshold\tFalse pos\tDetection rate\n"); 
-    double totalObjs; 
+    double totalObjs = 0.0; 
     for (int idx=idxStart; idx<nNumTh; idx++) 
     {
         totalObjs = 0.0; 
@@ -213,15 +245,79 @@ void ComputeROC()
                     detObjs += 1; 
         }
         printf ("%f\t%12.0lf\t%lf\n", th, falsePos, detObjs/totalObjs); 
+        pDetRate[idx] = detObjs/totalObjs; 
     }
 
-    printf ("The image set contains a total of %d positive objects", (int)totalObjs); 
-    ReleaseImgInfoVec(); 
+    printf ("The image set contains a total of %d positive objects\n", (int)totalObjs); 
+    printf ("%.0lf windows were scanned\n", totalWindows); 
+    *pIdxStart = idxStart; 
+    return totalWindows; 
+}
+
+// the recall the adaptive step costs at each threshold, against the full scan 
+void ReportAdaptiveStep(double *pDetRate, double *pSkipDetRate, int idxStart, 
+                        double windows, double skipWindows) 
+{
+    printf ("\nAdaptive step: maxSkip = %d, margin = %f, rows %s\n", 
+            nMaxSkip, fSkipMargin, bSkipRows ? "skipped" : "not skipped"); 
+    printf ("Windows scanned: %.0lf of %.0lf (%.1lf%%)\n", 
+            skipWindows, windows, windows > 0 ? 100.0*skipWindows/windows : 0.0); 
+    printf ("Threshold\tFull scan\tAdaptive\tRecall lost\n"); 
+    double maxLoss = 0.0; 
+    for (int idx=idxStart; idx<nNumTh; idx++) 
+    {
+        double loss = pDetRate[idx] - pSkipDetRate[idx]; 
+        printf ("%f\t%lf\t%lf\t%lf\n", pfTh[idx], pDetRate[idx], pSkipDetRate[idx], loss); 
+        if (loss > maxLoss) 
+            maxLoss = loss; 
+    }
+    printf ("Largest recall loss: %lf\n", maxLoss); 
+}
+
+// final thresholds for the cascade cut after each of pnCuts, the highest one that still 
+// detects as many faces as the whole cascade at the model's threshold 
+void CalibrateCuts(double *pDetRate, int idxStart, double windows) 
+{
+    DETECTOR model (szClassifierFile, fStepSize, fStepScale); 
+    int idxFinal = idxStart; 
+    while (idxFinal+1 < nNumTh && pfTh[idxFinal+1] <= model.GetFinalScoreTh()) 
+        idxFinal ++; 
+    double target = pDetRate[idxFinal]; 
+    printf ("\nWhole cascade: threshold %f, detection rate %lf\n", pfTh[idxFinal], target); 
+
+    double *pCutDetRate = new double [nNumTh]; 
+    int lookups = 0, numLookupStages = 0; 
+    printf ("Stages\tLookups\tThreshold\tDetection rate\tWindows\n"); 
+    for (int c=0; c<nNumCuts; c++) 
+    {
+        int numStages = pnCuts[c]; 
+        if (numStages <= 0 || numStages >= model.GetNumClassifiers()) 
+            throw "number of stages out of range"; 
+        int cutIdxStart; 
+        double cutWindows = ComputeROC(0, numStages, pCutDetRate, &cutIdxStart); 
+
+        int idx = cutIdxStart; 
+        while (idx+1 < nNumTh && pCutDetRate[idx+1] >= target) 
+            idx ++; 
+        if (pCutDetRate[idx] < target) 
+            printf ("Warning: %d stages never reach the detection rate, the lowest threshold is kept\n", numStages); 
+        model.SetTruncScoreTh(numStages, pfTh[idx]); 
+
+        for (; numLookupStages < numStages; numLookupStages++) 
+            lookups += model.GetLookups(numLookupStages, true); 
+        printf ("%d\t%d\t%f\t%lf\t%.0lf (%.1lf%%)\n", numStages, lookups, pfTh[idx], pCutDetRate[idx], 
+                cutWindows, windows > 0 ? 100.0*cutWindows/windows : 0.0); 
+    }
+    delete []pCutDetRate; 
+
+    model.SaveNewClassifier(szCalibratedFile); 
+    printf ("The calibrated model is saved to %s\n", szCalibratedFile); 
 }
 
 int main(int argc, char* argv[])
 {
-    if (argc != 5) 
+    bool bCalibrate = argc > 5 && strcmp(argv[5], "-calibrate") == 0; 
+    if (argc < 5 || (!bCalibrate && argc > 8) || (bCalibrate && argc < 8)) 
     {
         Usage(); 
         return -1; 
@@ -230,6 +326,23 @@ int main(int argc, char* argv[])
     float fMinTh = (float)atof(argv[2]); 
     float fMaxTh = (float)atof(argv[3]); 
     float fStepTh = (float)atof(argv[4]); 
+    if (bCalibrate) 
+    {
+        szCalibratedFile = argv[6]; 
+        nNumCuts = argc - 7; 
+        pnCuts = new int [nNumCuts]; 
+        for (int i=0; i<nNumCuts; i++) 
+            pnCuts[i] = atoi(argv[7+i]); 
+    }
+    else
+    {
+        if (argc > 5) 
+            nMaxSkip = atoi(argv[5]); 
+        if (argc > 6) 
+            fSkipMargin = (float)atof(argv[6]); 
+        if (argc > 7) 
+            bSkipRows = atoi(argv[7]) != 0; 
+    }
 
     nNumTh = 0; 
     for (float th = fMinTh; th <=fMaxTh; th+=fStepTh) 
@@ -240,12 +353,35 @@ int main(int argc, char* argv[])
 
     LoadTestFile(argv[1]); 
 
+    double *pDetRate = new double [nNumTh]; 
+    int idxStart; 
     clock_t tStart, tEnd;
     tStart = clock(); 
-    ComputeROC(); 
+    double windows = ComputeROC(0, 0, pDetRate, &idxStart); 
     tEnd = clock(); 
     printf ("Time taken to compute the ROC: %f sec\n", float(tEnd-tStart)/CLOCKS_PER_SEC); 
 
+    if (nMaxSkip > 0) 
+    {
+        double *pSkipDetRate = new double [nNumTh]; 
+        int skipIdxStart; 
+        printf ("\nWith the adaptive step:\n"); 
+        tStart = clock(); 
+        double skipWindows = ComputeROC(nMaxSkip, 0, pSkipDetRate, &skipIdxStart); 
+        tEnd = clock(); 
+        printf ("Time taken to compute the ROC: %f sec\n", float(tEnd-tStart)/CLOCKS_PER_SEC); 
+        ReportAdaptiveStep(pDetRate, pSkipDetRate, max(idxStart, skipIdxStart), windows, skipWindows); 
+        delete []pSkipDetRate; 
+    }
+
+    if (bCalibrate) 
+    {
+        CalibrateCuts(pDetRate, idxStart, windows); 
+        delete []pnCuts; 
+    }
+
+    ReleaseImgInfoVec(); 
+    delete []pDetRate; 
     delete []pfTh; 
 	return 0;
 }
@@ -44,6 +44,8 @@ BOOST::BOOST()
     for (int i=0; i<MAX_NUM_SCALE; i++) 
         m_RCFeatures[i] = NULL; 
 
+    m_pThreadPool = new THREADPOOL();   // one worker per processor 
+
 //    m_Rand.Seed(0); 
     m_Rand.Seed((int)time(NULL)); 
 }
@@ -75,6 +77,8 @@ BOOST::BOOST(const char *szListFile)
     for (int i=0; i<MAX_NUM_SCALE; i++) 
         m_RCFeatures[i] = NULL; 
 
+    m_pThreadPool = new THREADPOOL();   // one worker per processor 
+
 //    m_Rand.Seed(0); 
     m_Rand.Seed((int)time(NULL)); 
 
@@ -92,6 +96,7 @@ BOOST::~BOOST()
         m_pfScoreBuf = NULL; 
         m_nScoreBufSize = 0; 
     }
+    delete m_pThreadPool; 
 }
 
 void BOOST::ReleaseRCFeatures()
@@ -352,11 +357,10 @@ void BOOST::ComputeAllFeatures(int nStart, int nEnd, int nIdx)
     }
 }
 
-DWORD WINAPI ComputeAllFeaturesThreadProc(LPVOID lpParam)
+void ComputeAllFeaturesTaskProc(void *pParam)
 {
-    THREADPROC_PARA *pPara = (THREADPROC_PARA *)lpParam; 
+    THREADPROC_PARA *pPara = (THREADPROC_PARA *)pParam; 
     pPara->m_pBoost->ComputeAllFeatures(pPara->m_nStart, pPara->m_nEnd, pPara->m_nIdx);
-    return 0; 
 }
 
 void BOOST::SampleExamples4FeatureSelection()
@@ -374,12 +378,12 @@ void BOOST::SampleExamples4FeatureSelection()
         m_dRandNums[i] = m_Rand.URand(0.0, sumWeight); 
     qsort(m_dRandNums, m_nNumSampledExamples, sizeof(double), compare_double); 
 
-    THREADPROC_PARA tpPara[NUM_PROC_THREADS]; 
-    for (int i=0; i<NUM_PROC_THREADS; i++) 
+    int numTasks = m_pThreadPool->GetNumThreads(); 
+    THREADPROC_PARA *tpPara = new THREADPROC_PARA [numTasks]; 
+    for (int i=0; i<numTasks; i++) 
         tpPara[i].m_pBoost = this; 
     tpPara[0].m_nStart = 0; 
     tpPara[0].m_nIdx = 0; 
-    tpPara[NUM_PROC_THREADS-1].m_nEnd = m_nNumExamples-1; 
 
     int idx = 0; 
     int tpIdx = 0; 
@@ -395,32 +399,17 @@ void BOOST::SampleExamples4FeatureSelection()
                                      // but there shouldn't be an example who is sampled over 2^15 times 
             idx ++; 
         }
-        if (tpIdx<NUM_PROC_THREADS-1 && idx > (tpIdx+1)*m_nNumSampledExamples/NUM_PROC_THREADS) 
+        if (tpIdx<numTasks-1 && idx > (tpIdx+1)*(double)m_nNumSampledExamples/numTasks) 
         {
             tpPara[tpIdx++].m_nEnd = i; 
             tpPara[tpIdx].m_nStart = i+1; 
             tpPara[tpIdx].m_nIdx = idx; 
         }
     }
+    tpPara[tpIdx].m_nEnd = m_nNumExamples-1;    // the last range may end early when there are few examples 
 
-    HANDLE hThread[NUM_PROC_THREADS]; 
-    DWORD dwThreadId[NUM_PROC_THREADS]; 
-    for (int i=0; i<NUM_PROC_THREADS; i++) 
-    {
-        hThread[i] = CreateThread(
-            NULL,                           // default security
-            0,                              // use default stack size
-            ComputeAllFeaturesThreadProc,   // thread function
-            &tpPara[i],                     // augument to thread function
-            0,                              // use default creation flags
-            &dwThreadId[i]);                // returns the thread identifier
-        if (hThread[i] == NULL) 
-            throw "Thread creation failed"; 
-    }
-
-    WaitForMultipleObjects(NUM_PROC_THREADS, hThread, TRUE, INFINITE); 
-    for (int i=0; i<NUM_PROC_THREADS; i++) 
-        CloseHandle(hThread[i]); 
+    m_pThreadPool->Run(ComputeAllFeaturesTaskProc, tpPara, sizeof(THREADPROC_PARA), tpIdx+1); 
+    delete []tpPara; 
 
     printf("Done!\n"); 
 }
@@ -532,27 +521,8 @@ void BOOST::ReadScoreFile(int idx)
     char fname[MAX_PATH]; 
     sprintf (fname, "%s%03d.dat", m_fScoreFilePrefix, idx); 
 
-    //FILE *fp = fopen(fname, "rb"); 
-    //if (fp == NULL) 
-    //    throw "Unable to open file for read!"; 
-    //fread(m_pfScoreBuf, sizeof(float), m_nScoreBufSize, fp); 
-    //fclose(fp); 
-
-    HANDLE hFile; 
-    hFile = CreateFile(fname,                   // file name
-                    GENERIC_READ,              // open for write 
-                    FILE_SHARE_READ,           // share for write
-                    NULL,                       // no security 
-                    OPEN_EXISTING,              // always create
-                    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,     // normal file, sequencial scan
-                    NULL);                      // no attr. template 
-
-    if (hFile == INVALID_HANDLE_VALUE) 
-        throw "Unable to open file for write!"; 
-
-    DWORD numBytesWritten; 
-    ReadFile (hFile, m_pfScoreBuf, m_nScoreBufSize*sizeof(float), &numBytesWritten, NULL); 
-	CloseHandle(hFile);
+    if (!ReadBinaryFile(fname, m_pfScoreBuf, (size_t)m_nScoreBufSize*sizeof(float))) 
+        throw "Unable to read score file!"; 
 
     //clock_t t1 = clock(); 
     //printf ("Times taken to read one score file: %f sec\n", 
@@ -564,27 +534,8 @@ void BOOST::WriteScoreFile(int idx)
     char fname[MAX_PATH]; 
     sprintf (fname, "%s%03d.dat", m_fScoreFilePrefix, idx); 
 
-    //FILE *fp = fopen(fname, "wb"); 
-    //if (fp == NULL) 
-    //    throw "Unable to open file for write!"; 
-    //fwrite(m_pfScoreBuf, sizeof(float), m_nScoreBufSize, fp); 
-    //fclose(fp); 
-
-    HANDLE hFile; 
-    hFile = CreateFile(fname,                   // file name
-                    GENERIC_WRITE,              // open for write 
-                    FILE_SHARE_WRITE,           // share for write
-                    NULL,                       // no security 
-                    CREATE_ALWAYS,              // always create
-                    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,     // normal file, sequencial scan
-                    NULL);                      // no attr. template 
-     
-    if (hFile == INVALID_HANDLE_VALUE) 
-        throw "Unable to open file for write!"; 
-
-    DWORD numBytesWritten; 
-    WriteFile (hFile, m_pfScoreBuf, m_nScoreBufSize*sizeof(float), &numBytesWritten, NULL); 
-	CloseHandle(hFile);
+    if (!WriteBinaryFile(fname, m_pfScoreBuf, (size_t)m_nScoreBufSize*sizeof(float))) 
+        throw "Unable to write score file!"; 
 }
 
 // update the scores of ALL rectangles, return minimum and maximum score 
@@ -712,7 +663,7 @@ void BOOST::UpdateAllScores(CLASSIFIER *pC, int num)
             break; 
     }
     negCount -= pdNegCount[i]; 
-    m_RemaskPara.m_fScoreTh = (float)(MIN_SCORE + max(step*(i-0.5),0)); 
+    m_RemaskPara.m_fScoreTh = (float)(MIN_SCORE + max(step*(i-0.5),0.0)); 
     m_RemaskPara.m_dNegScoreThCount -= negCount; 
     m_RemaskPara.m_dSampleRatio = (m_nMaxNumExamples-m_RemaskPara.m_dTotalPosCount)/m_RemaskPara.m_dNegScoreThCount; 
     if (m_RemaskPara.m_dSampleRatio > 1.0) 
@@ -919,7 +870,7 @@ float BOOST::FindInitScore()
 bool BOOST::LoadImageInfo(const char *szPath, int *index)
 {
     char szName[MAX_PATH]; 
-    sprintf(szName, "%s\\label.txt", szPath); 
+    sprintf(szName, "%s" PATH_SEPARATOR_STR "label.txt", szPath); 
     FILE *fpLabel = fopen(szName, "r"); 
     if (fpLabel == NULL) 
     {
@@ -1048,11 +999,10 @@ bool BOOST::LoadImageInfo(const char *szPath, int *index)
     return true; 
 }
 
-DWORD WINAPI SelectOneFeatureThreadProc(LPVOID lpParam)
+void SelectOneFeatureTaskProc(void *pParam)
 {
-    THREADPROC_PARA *pPara = (THREADPROC_PARA *)lpParam; 
+    THREADPROC_PARA *pPara = (THREADPROC_PARA *)pParam; 
     pPara->m_pBoost->SelectOneFeatureProc(pPara->m_nStart, pPara->m_nEnd, pPara->m_pVI);
-    return 0; 
 }
 
 void BOOST::SelectOneFeatureProc(int nStart, int nEnd, VALUEINDEX *pVI)
@@ -1209,45 +1159,30 @@ int BOOST::SelectOneFeature(CLASSIFIER *pC)
     int nNumFeatures = m_nNumRCFeatures; 
     printf ("A total of %d features will be processed. This may take a few minutes...", nNumFeatures); 
 
-    VALUEINDEX pVI[NUM_PROC_THREADS][NUM_TOP_FEATURES]; 
-    for (int i=0; i<NUM_PROC_THREADS; i++) 
+    int numTasks = m_pThreadPool->GetNumThreads(); 
+    VALUEINDEX (*pVI)[NUM_TOP_FEATURES] = new VALUEINDEX [numTasks][NUM_TOP_FEATURES]; 
+    for (int i=0; i<numTasks; i++) 
         pVI[i][0].m_fVal = (float)sqrt(posSum*negSum); 
 
-    THREADPROC_PARA tpPara[NUM_PROC_THREADS]; 
-    for (int i=0; i<NUM_PROC_THREADS; i++) 
+    THREADPROC_PARA *tpPara = new THREADPROC_PARA [numTasks]; 
+    for (int i=0; i<numTasks; i++) 
     {
         tpPara[i].m_pBoost = this; 
-        tpPara[i].m_nStart = i*nNumFeatures/NUM_PROC_THREADS; 
-        tpPara[i].m_nEnd = (i+1)*nNumFeatures/NUM_PROC_THREADS-1; 
+        tpPara[i].m_nStart = (int)((__int64)i*nNumFeatures/numTasks); 
+        tpPara[i].m_nEnd = (int)((__int64)(i+1)*nNumFeatures/numTasks)-1; 
         tpPara[i].m_pVI = pVI[i];
     }
-    tpPara[NUM_PROC_THREADS-1].m_nEnd = nNumFeatures-1; 
-
-    HANDLE hThread[NUM_PROC_THREADS]; 
-    DWORD dwThreadId[NUM_PROC_THREADS]; 
-    for (int i=0; i<NUM_PROC_THREADS; i++) 
-    {
-        hThread[i] = CreateThread(
-            NULL,                           // default security
-            0,                              // use default stack size
-            SelectOneFeatureThreadProc,     // thread function
-            &tpPara[i],                     // augument to thread function
-            0,                              // use default creation flags
-            &dwThreadId[i]);                // returns the thread identifier
-        if (hThread[i] == NULL) 
-            throw "Thread creation failed"; 
-    }
+    tpPara[numTasks-1].m_nEnd = nNumFeatures-1; 
 
-    WaitForMultipleObjects(NUM_PROC_THREADS, hThread, TRUE, INFINITE); 
-    for (int i=0; i<NUM_PROC_THREADS; i++) 
-        CloseHandle(hThread[i]); 
+    m_pThreadPool->Run(SelectOneFeatureTaskProc, tpPara, sizeof(THREADPROC_PARA), numTasks); 
+    delete []tpPara; 
     printf ("Done!\n"); 
 
     VALUEINDEX tmpVI = {-1, (float)sqrt(posSum*negSum)}; 
     vector<VALUEINDEX> topFeatureVec; 
     vector<VALUEINDEX>::iterator it; 
     topFeatureVec.assign(NUM_TOP_FEATURES, tmpVI); 
-    for (int i=0; i<NUM_PROC_THREADS; i++) 
+    for (int i=0; i<numTasks; i++) 
         for (int j=0; j<NUM_TOP_FEATURES; j++)
         {
             tmpVI = topFeatureVec.back(); 
@@ -1266,6 +1201,7 @@ int BOOST::SelectOneFeature(CLASSIFIER *pC)
                 topFeatureVec.pop_back(); 
             }
         }
+    delete []pVI; 
 
     // now use the whole example set to select the top feature
     printf("Select among the top features..."); 
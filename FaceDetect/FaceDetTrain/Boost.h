@@ -7,6 +7,8 @@
 #include "feature.h"
 #include "classifier.h"
 #include "BitCodec.h"
+#include "threadpool.h"
+#include "fileio.h"
 
 //#define USE_ROBUST_SAMPLING
 #if defined(USE_ROBUST_SAMPLING)
@@ -22,7 +24,6 @@
 #define MAX_ITER                5
 #define MIN_SCORE               (-30)
 #define MAX_SCORE               (-MIN_SCORE)
-#define NUM_PROC_THREADS        4
 
 struct VALUEINDEX
 {
@@ -109,6 +110,8 @@ class BOOST
 
     int             m_nUpdateScoreIdx; 
 
+    THREADPOOL    * m_pThreadPool;  // workers for feature evaluation/selection, sized from the hardware 
+
 private: 
     void            ReleaseRCFeatures(); 
     void            ReleaseImgInfoVec(); 
@@ -2,7 +2,7 @@
 //
 
 #include "stdafx.h"
-#include "boost.h"
+#include "Boost.h"
 
 void Usage()
 {
@@ -14,13 +14,48 @@ void Usage()
         "FaceDetTrain fileName \n"
         "\n"
         "    fileName      -- name of a train configuration file\n"
+        "\n"
+        "FaceDetTrain -prefilter classifier numStages prefilter [slack]\n"
+        "\n"
+        "    classifier    -- a trained classifier file\n"
+        "    numStages     -- number of leading stages the prefilter is made of\n"
+        "    prefilter     -- name of the prefilter file to write, it runs at half\n"
+        "                     resolution, see DETECTOR::SetPrefilter()\n"
+        "    slack         -- how much lower its minimum positive scores are (default 0.5)\n"
         "\n";
 
     printf("%s\n", msg);
 }
 
+// the leading stages of a trained classifier as a half resolution prefilter 
+int ExtractPrefilter(const char *szClassifier, int numStages, const char *szPrefilter, float slack)
+{
+    int nClassifiers, nBaseWidth, nBaseHeight, nNumFTh; 
+    float fThreshold; 
+    CLASSIFIER *pClassifier = CLASSIFIER::ReadClassifierFile(&nClassifiers, &nBaseWidth, &nBaseHeight, 
+                                                             &nNumFTh, &fThreshold, szClassifier); 
+    numStages = min(numStages, nClassifiers); 
+    if (numStages <= 0) 
+    {
+        CLASSIFIER::DeleteClassifierArray(pClassifier); 
+        return -1; 
+    }
+
+    CLASSIFIER *pPrefilter = CLASSIFIER::CreatePrefilterArray(pClassifier, numStages, slack); 
+    CLASSIFIER::WriteClassifierFile(pPrefilter, numStages, (nBaseWidth+1)/2, (nBaseHeight+1)/2, nNumFTh, 
+                                    pPrefilter[numStages-1].GetMinPosScoreTh(), szPrefilter); 
+    printf ("%d of %d stages written to %s\n", numStages, nClassifiers, szPrefilter); 
+
+    CLASSIFIER::DeleteClassifierArray(pPrefilter); 
+    CLASSIFIER::DeleteClassifierArray(pClassifier); 
+    return 0; 
+}
+
 int main(int argc, char* argv[])
 {
+    if ((argc == 5 || argc == 6) && strcmp(argv[1], "-prefilter") == 0) 
+        return ExtractPrefilter(argv[2], atoi(argv[3]), argv[4], argc == 6 ? (float)atof(argv[5]) : 0.5f); 
+
     if (argc != 2) 
     {
         Usage(); 
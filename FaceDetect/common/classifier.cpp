@@ -5,6 +5,7 @@
 \******************************************************************************/
 
 #include "stdafx.h"
+#include <float.h>
 #include "classifier.h"
 
 CLASSIFIER::CLASSIFIER()
@@ -47,7 +48,8 @@ void CLASSIFIER::DuplicateClassifier(CLASSIFIER *cfsrc, CLASSIFIER *cfdst, float
 *
 \******************************************************************************/
 
-CLASSIFIER* CLASSIFIER::ReadClassifierFile(int *pCount, int *pBW, int *pBH, int *pNumFTh, float *pTh, const char *fileName)
+CLASSIFIER* CLASSIFIER::ReadClassifierFile(int *pCount, int *pBW, int *pBH, int *pNumFTh, float *pTh, const char *fileName, 
+                                           float **ppTruncTh)
 {
     FILE *file = fopen(fileName, "r");
     if (file == NULL) throw "fopen";
@@ -71,6 +73,30 @@ CLASSIFIER* CLASSIFIER::ReadClassifierFile(int *pCount, int *pBW, int *pBH, int
     if (fscanf(file, "%f", pTh) != 1)   // final decision threshold 
         throw "decision threshold"; 
 
+    // optional: the number of truncated cascades calibrated, then a line "numStages threshold" each 
+    if (ppTruncTh) 
+    {
+        float *pTruncTh = new float [*pCount+1]; 
+        for (int i=0; i<=*pCount; i++) 
+            pTruncTh[i] = -FLT_MAX; 
+        int num, numStages; 
+        if (fscanf(file, "%d", &num) == 1) 
+        {
+            for (int i=0; i<num; i++) 
+            {
+                float th; 
+                if (fscanf(file, "%d %f", &numStages, &th) != 2 || numStages <= 0 || numStages >= *pCount) 
+                {
+                    delete []pTruncTh; 
+                    fclose(file); 
+                    throw "truncation threshold"; 
+                }
+                pTruncTh[numStages] = th; 
+            }
+        }
+        *ppTruncTh = pTruncTh; 
+    }
+
     if (fclose(file) != 0)
         throw "fclose";
 
@@ -138,6 +164,24 @@ CLASSIFIER * CLASSIFIER::CreateScaledClassifierArray(CLASSIFIER *classifierArray
     return scaledClassifierArray; 
 }
 
+CLASSIFIER * CLASSIFIER::CreatePrefilterArray(CLASSIFIER *classifierArray, int nClassifiers, float slack)
+{
+    CLASSIFIER *prefilterArray = new CLASSIFIER [nClassifiers]; 
+    if (!prefilterArray) 
+        throw "out of memory"; 
+    for (int i=0; i<nClassifiers; i++) 
+    {
+        CLASSIFIER *src = &classifierArray[i]; 
+        CLASSIFIER *dst = &prefilterArray[i]; 
+        DuplicateClassifier(src, dst); 
+        if (src->m_Feature.m_nType == FEATURE::RECTFEATURE) 
+            dst->m_Feature.m_pF.pRCF->InitHalf(src->m_Feature.m_pF.pRCF); 
+        dst->SetMinPosScoreTh(src->GetMinPosScoreTh() - slack); 
+    }
+
+    return prefilterArray; 
+}
+
 
 /******************************************************************************\
 *
@@ -174,7 +218,8 @@ void CLASSIFIER::Write(FILE *file)
 \******************************************************************************/
 
 void CLASSIFIER::WriteClassifierFile(CLASSIFIER *classifierArray, int nClassifiers, 
-                                     int baseWidth, int baseHeight, int numFTh, float threshold, const char *fileName)
+                                     int baseWidth, int baseHeight, int numFTh, float threshold, const char *fileName, 
+                                     const float *pTruncTh)
 {
     FILE *file = fopen (fileName, "w"); 
     if (file == NULL) 
@@ -184,6 +229,18 @@ void CLASSIFIER::WriteClassifierFile(CLASSIFIER *classifierArray, int nClassifie
     for (int i=0; i<nClassifiers; i++) 
         classifierArray[i].Write(file); 
     fprintf (file, "%f\n", threshold); 
+    if (pTruncTh) 
+    {
+        int num = 0; 
+        for (int i=1; i<nClassifiers; i++) 
+            if (pTruncTh[i] > -FLT_MAX) 
+                num ++; 
+        if (num > 0) 
+            fprintf (file, "%d\n", num); 
+        for (int i=1; i<nClassifiers; i++) 
+            if (pTruncTh[i] > -FLT_MAX) 
+                fprintf (file, "%d %f\n", i, pTruncTh[i]); 
+    }
     fclose(file); 
 }
 
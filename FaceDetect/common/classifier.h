@@ -34,11 +34,20 @@ public:
     void Write(FILE *file); 
 
     static void DuplicateClassifier(CLASSIFIER *cfsrc, CLASSIFIER *cfdst, float scale=1.0f); 
-    static CLASSIFIER * ReadClassifierFile(int *pCount, int *pBW, int *pBH, int *pNumFTh, float *pTh, const char *fileName);
+    // with ppTruncTh the optional section after the final threshold is read too: (*ppTruncTh)[n] is 
+    // the final threshold calibrated for the cascade cut after n classifiers, -FLT_MAX where there 
+    // is none. the array has *pCount+1 entries, the caller deletes it 
+    static CLASSIFIER * ReadClassifierFile(int *pCount, int *pBW, int *pBH, int *pNumFTh, float *pTh, const char *fileName, 
+                                           float **ppTruncTh = NULL);
     static CLASSIFIER * CreateClassifierArray(int *pCount, int *pNumFTh, FILE *file);
     static CLASSIFIER * CreateClassifierArray(int count, int numFTh); 
     static CLASSIFIER * CreateScaledClassifierArray(CLASSIFIER *classifierArray, int nClassifiers, float scale); 
+    // the first nClassifiers of classifierArray as a prefilter for the 2x subsampled integral 
+    // image, see RCFEATURE::InitHalf(). the minimum positive scores are lowered by slack to 
+    // make up for the rectangles that moved when halved 
+    static CLASSIFIER * CreatePrefilterArray(CLASSIFIER *classifierArray, int nClassifiers, float slack); 
     static void WriteClassifierFile(CLASSIFIER *classifierArray, int nClassifiers, 
-        int baseWidth, int baseHeight, int numFTh, float threshold, const char *fileName);
+        int baseWidth, int baseHeight, int numFTh, float threshold, const char *fileName, 
+        const float *pTruncTh = NULL);
     static void DeleteClassifierArray(CLASSIFIER *classifierArray); 
 };
\ No newline at end of file
@@ -0,0 +1,214 @@
+/******************************************************************************\
+*
+*   Member functions for the DETATLAS class
+*
+\******************************************************************************/
+
+#include "stdafx.h"
+#include "detatlas.h"
+
+DETATLAS::DETATLAS(int width, int height, int guard, int align) :
+    m_nGuard(max(guard, 1)),
+    m_nAlign(max(align, 1)),
+    m_nNumTiles(0),
+    m_nMaxTiles(0),
+    m_pTiles(NULL),
+    m_nRowX(0),
+    m_nRowY(0),
+    m_nRowHeight(0),
+    m_nMaxTileWidth(0),
+    m_nMaxTileHeight(0),
+    m_nNumRect(0),
+    m_nMaxRect(0),
+    m_pRect(NULL),
+    m_pTileOf(NULL)
+{
+    m_Image.Realloc(width, height);
+    m_Mask.Realloc(width, height);
+    memset(m_Image.GetDataPtr(), 0, m_Image.GetStride()*height);
+    memset(m_Mask.GetDataPtr(), 0, m_Mask.GetStride()*height);
+    Reset();
+}
+
+DETATLAS::~DETATLAS()
+{
+    if (m_pTiles) { delete []m_pTiles; m_pTiles = NULL; }
+    if (m_pRect) { delete []m_pRect; m_pRect = NULL; }
+    if (m_pTileOf) { delete []m_pTileOf; m_pTileOf = NULL; }
+}
+
+void DETATLAS::Reset()
+{
+    // only the rows used so far have tiles on the mask
+    int usedHeight = min(m_nRowY + m_nRowHeight, m_Mask.GetHeight());
+    if (m_nNumTiles > 0)
+        memset(m_Mask.GetDataPtr(), 0, m_Mask.GetStride()*usedHeight);
+    m_nNumTiles = 0;
+    m_nRowX = 0;
+    m_nRowY = 0;
+    m_nRowHeight = 0;
+    m_nMaxTileWidth = 0;
+    m_nMaxTileHeight = 0;
+    m_nNumRect = 0;
+}
+
+int DETATLAS::Add(const BYTE *pData, int width, int height, int stride)
+{
+    if (width > m_Image.GetWidth() || height > m_Image.GetHeight())
+        throw "image too large for the atlas";
+
+    // next to the last tile, or at the start of a new row of tiles below
+    int x = m_nRowX, y = m_nRowY;
+    if (x + width > m_Image.GetWidth())
+    {
+        x = 0;
+        y = (m_nRowY + m_nRowHeight + m_nGuard + m_nAlign-1) / m_nAlign * m_nAlign;
+    }
+    if (y + height > m_Image.GetHeight())
+        return -1;
+    if (x == 0 && y != m_nRowY)
+    {
+        m_nRowY = y;
+        m_nRowHeight = 0;
+    }
+
+    if (m_nNumTiles >= m_nMaxTiles)
+    {
+        int maxTiles = max(2*m_nMaxTiles, 64);
+        TILE *pTiles = new TILE [maxTiles];
+        if (!pTiles)
+            throw "out of memory";
+        if (m_pTiles)
+        {
+            memcpy(pTiles, m_pTiles, m_nNumTiles*sizeof(TILE));
+            delete []m_pTiles;
+        }
+        m_pTiles = pTiles;
+        m_nMaxTiles = maxTiles;
+    }
+
+    for (int iY = 0; iY < height; iY++)
+    {
+        memcpy(m_Image.GetDataPtr() + (y+iY)*m_Image.GetStride() + x, pData + iY*stride, width);
+        memset(m_Mask.GetDataPtr() + (y+iY)*m_Mask.GetStride() + x, 1, width);
+    }
+
+    TILE &tile = m_pTiles[m_nNumTiles];
+    tile.m_nX = x;
+    tile.m_nY = y;
+    tile.m_nWidth = width;
+    tile.m_nHeight = height;
+    tile.m_nFirstRect = 0;
+    tile.m_nNumRect = 0;
+    m_nRowX = (x + width + m_nGuard + m_nAlign-1) / m_nAlign * m_nAlign;
+    m_nRowHeight = max(m_nRowHeight, height);
+    m_nMaxTileWidth = max(m_nMaxTileWidth, width);
+    m_nMaxTileHeight = max(m_nMaxTileHeight, height);
+    return m_nNumTiles++;
+}
+
+int DETATLAS::Add(const IMAGE *pImage)
+{
+    return Add(pImage->GetDataPtr(), pImage->GetWidth(), pImage->GetHeight(), pImage->GetStride());
+}
+
+bool DETATLAS::Detect(DETECTOR *pDetector, DETWORKSPACE *pWS, int minScale, int maxScale)
+{
+    m_nNumRect = 0;
+    for (int i=0; i<m_nNumTiles; i++)
+        m_pTiles[i].m_nNumRect = 0;
+    if (m_nNumTiles == 0)
+        return true;
+
+    // a window larger than every tile could never pass the region mask
+    while (maxScale >= minScale && (pDetector->GetWindowWidth(maxScale) > m_nMaxTileWidth ||
+                                    pDetector->GetWindowHeight(maxScale) > m_nMaxTileHeight))
+        maxScale --;
+    if (maxScale < minScale)
+        return true;
+
+    // the rows below the last row of tiles are left out. every tile may fill the raw list
+    // as far as the detector lets one image do, so one busy tile does not starve the others
+    int height = m_nRowY + m_nRowHeight;
+    IMAGE image(m_Image.GetWidth(), height, m_Image.GetStride(), m_Image.GetDataPtr());
+    IMAGE mask(m_Mask.GetWidth(), height, m_Mask.GetStride(), m_Mask.GetDataPtr());
+    int maxNumRaw = m_nNumTiles * pDetector->GetMaxNumRawDetRect();
+    pWS->GetIImage()->Init(&image);
+    pWS->SetRegionMask(&mask);
+    pDetector->ScanObject(pWS, minScale, maxScale, maxNumRaw);
+
+    SCORED_RECT *pRc;
+    int num = pWS->GetDetResults(&pRc, false);
+    bool bComplete = num < maxNumRaw;
+    if (num > m_nMaxRect)
+    {
+        if (m_pRect) { delete []m_pRect; m_pRect = NULL; }
+        if (m_pTileOf) { delete []m_pTileOf; m_pTileOf = NULL; }
+        m_nMaxRect = 0;
+        m_pRect = new SCORED_RECT [num];
+        m_pTileOf = new int [num];
+        if (!m_pRect || !m_pTileOf)
+            throw "out of memory";
+        m_nMaxRect = num;
+    }
+
+    // group the raw windows by tile, each lies inside one tile
+    int *pTileOf = m_pTileOf;
+    for (int k=0; k<num; k++)
+    {
+        const IRECT &rc = pRc[k].m_rect;
+        int t = 0;
+        while (t < m_nNumTiles-1 &&
+               (rc.m_ixMin < m_pTiles[t].m_nX || rc.m_ixMin >= m_pTiles[t].m_nX + m_pTiles[t].m_nWidth ||
+                rc.m_iyMin < m_pTiles[t].m_nY || rc.m_iyMin >= m_pTiles[t].m_nY + m_pTiles[t].m_nHeight))
+            t ++;
+        pTileOf[k] = t;
+        m_pTiles[t].m_nNumRect ++;
+    }
+    for (int t=0, first=0; t<m_nNumTiles; t++)
+    {
+        m_pTiles[t].m_nFirstRect = first;
+        first += m_pTiles[t].m_nNumRect;
+        m_pTiles[t].m_nNumRect = 0;
+    }
+    for (int k=0; k<num; k++)
+    {
+        TILE &tile = m_pTiles[pTileOf[k]];
+        SCORED_RECT &dst = m_pRect[tile.m_nFirstRect + tile.m_nNumRect++];
+        dst = pRc[k];
+        dst.m_rect.m_ixMin -= tile.m_nX;
+        dst.m_rect.m_ixMax -= tile.m_nX;
+        dst.m_rect.m_iyMin -= tile.m_nY;
+        dst.m_rect.m_iyMax -= tile.m_nY;
+    }
+
+    // merge each tile on its own. a tile never has more detections than raw windows, so the
+    // detections are written back over the raw windows of the tiles already merged
+    for (int t=0; t<m_nNumTiles; t++)
+    {
+        TILE &tile = m_pTiles[t];
+        int numRaw = tile.m_nNumRect;
+        if (numRaw >= MAX_NUM_MERGE_RECT)
+            bComplete = false;
+        m_TileWS.Reserve(numRaw);
+        for (int k=0; k<numRaw; k++)
+            m_TileWS.m_pRawDetRect[k] = m_pRect[tile.m_nFirstRect + k];
+        m_TileWS.m_nNumRawDetRect = numRaw;
+        pDetector->MergeDetResults(&m_TileWS);
+
+        SCORED_RECT *pMerged;
+        tile.m_nNumRect = m_TileWS.GetDetResults(&pMerged, true);
+        tile.m_nFirstRect = m_nNumRect;
+        for (int k=0; k<tile.m_nNumRect; k++)
+            m_pRect[m_nNumRect++] = pMerged[k];
+    }
+    return bComplete;
+}
+
+int DETATLAS::GetDetResults(int tile, SCORED_RECT **ppRc)
+{
+    if (tile < 0 || tile >= m_nNumTiles)
+        throw "tile out of range";
+    *ppRc = m_pRect + m_pTiles[tile].m_nFirstRect;
+    return m_pTiles[tile].m_nNumRect;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+/******************************************************************************\
+*
+*   DETATLAS
+*
+*       Batch detection for many small images (avatars, thumbnails). Each
+*       call on a tiny image pays for a whole scan setup over a grid of a few
+*       windows, so the images are packed side by side into one atlas, in
+*       rows of tiles, and the atlas is scanned once: one integral image, one
+*       pass over the scales. The raw windows are then merged tile by tile,
+*       so each image gets the raw budget and the merge limit it would have
+*       alone, and the detections are handed back per image, in the
+*       coordinates of that image.
+*
+*       The tiles are kept apart by a guard border and the scan goes through
+*       a region mask (DETWORKSPACE::SetRegionMask) that only lets through the
+*       windows lying entirely inside one tile. The windows across a border
+*       are skipped before any classifier runs, so no detection can mix two
+*       images and the guard needs no more than a pixel.
+*
+*       The window grid is that of the atlas, not of each image, so the
+*       windows land a few pixels off from where a scan of the image alone
+*       would put them, and the faces found differ the way they do when an
+*       image is shifted by a few pixels. With align set to the detector's
+*       step at a scale, the windows of that scale are exactly those of the
+*       single image scan.
+*
+*       Typical use:
+*
+*           DETATLAS atlas;
+*           for each image
+*           {
+*               if (atlas.Add(&image) < 0)      // full: scan what is in it
+*               {
+*                   atlas.Detect(&detector, &ws);    // false: some tiles lost windows
+*                   ... atlas.GetDetResults(tile, &pRc) for each tile ...
+*                   atlas.Reset();
+*                   atlas.Add(&image);
+*               }
+*           }
+*
+\******************************************************************************/
+
+#include "detector.h"
+
+#define DEFAULT_ATLAS_WIDTH                 1024
+#define DEFAULT_ATLAS_HEIGHT                1024
+#define DEFAULT_ATLAS_GUARD                 1       // pixels between tiles
+#define DEFAULT_ATLAS_ALIGN                 1       // tile corners at multiples of this
+
+class DETATLAS
+{
+    struct TILE
+    {
+        int             m_nX;               // top left corner in the atlas
+        int             m_nY;
+        int             m_nWidth;
+        int             m_nHeight;
+        int             m_nFirstRect;       // its detections in m_pRect
+        int             m_nNumRect;
+    };
+
+    int             m_nGuard;
+    int             m_nAlign;
+    IMAGE           m_Image;                // the packed gray pixels
+    IMAGE           m_Mask;                 // 1 on the tiles, 0 on the guard and the free space
+    int             m_nNumTiles;
+    int             m_nMaxTiles;
+    TILE          * m_pTiles;
+    int             m_nRowX;                // where the next tile goes in the current row of tiles
+    int             m_nRowY;
+    int             m_nRowHeight;
+    int             m_nMaxTileWidth;
+    int             m_nMaxTileHeight;
+    int             m_nNumRect;
+    int             m_nMaxRect;
+    SCORED_RECT   * m_pRect;                // raw windows, then detections of all tiles, grouped by tile
+    int           * m_pTileOf;              // tile of each raw window, scratch of Detect()
+    DETWORKSPACE    m_TileWS;               // merges the raw windows of one tile
+
+public:
+    DETATLAS(int width = DEFAULT_ATLAS_WIDTH, int height = DEFAULT_ATLAS_HEIGHT, int guard = DEFAULT_ATLAS_GUARD,
+             int align = DEFAULT_ATLAS_ALIGN);
+    ~DETATLAS();
+
+    // empty the atlas for the next batch
+    void            Reset();
+
+    // copy an 8-bit gray image into the next free tile, returns the tile index or -1 when
+    // the atlas has no room left. an image larger than the whole atlas throws
+    int             Add(const BYTE *pData, int width, int height, int stride);
+    int             Add(const IMAGE *pImage);
+    int             GetCount()      { return m_nNumTiles; };
+
+    // scan all tiles at once with pWS, scales too large for every tile are left out. the raw
+    // list of pWS holds the detector's limit times the number of tiles, and pWS is left with
+    // the raw windows of the whole atlas. returns false when some detections were lost: the
+    // raw list filled up and the rest of the atlas went unscanned, or a tile had too many raw
+    // windows to merge (MAX_NUM_MERGE_RECT) and got them back unmerged
+    bool            Detect(DETECTOR *pDetector, DETWORKSPACE *pWS, int minScale=0, int maxScale=MAX_NUM_SCALE-1);
+    // merged detections of one tile, in the coordinates of its image
+    int             GetDetResults(int tile, SCORED_RECT **ppRc);
+};
@@ -0,0 +1,326 @@
+/******************************************************************************\
+*
+*   Member functions for the DETCACHE class
+*
+\******************************************************************************/
+
+#include "stdafx.h"
+#include "detcache.h"
+
+DETCACHE::DETCACHE(int capacity) :
+    m_nCapacity(max(capacity, 1)),
+    m_nCount(0),
+    m_pEntries(NULL),
+    m_nHead(-1),
+    m_nTail(-1),
+    m_nMaxDistance(DEFAULT_CACHE_MAX_DISTANCE),
+    m_fAspectTolerance(DEFAULT_CACHE_ASPECT_TOLERANCE),
+    m_nHits(0),
+    m_nMisses(0)
+{
+    m_pEntries = new ENTRY [m_nCapacity];
+    if (!m_pEntries)
+        throw "out of memory";
+    for (int i=0; i<m_nCapacity; i++)
+        m_pEntries[i].m_pRect = NULL;
+    InitThreadLock(&m_Lock);
+}
+
+DETCACHE::~DETCACHE()
+{
+    Clear();
+    delete []m_pEntries;
+    DeleteThreadLock(&m_Lock);
+}
+
+void DETCACHE::Clear()
+{
+    EnterThreadLock(&m_Lock);
+    for (int i=0; i<m_nCount; i++)
+    {
+        if (m_pEntries[i].m_pRect) { delete []m_pEntries[i].m_pRect; m_pEntries[i].m_pRect = NULL; }
+    }
+    m_nCount = 0;
+    m_nHead = m_nTail = -1;
+    LeaveThreadLock(&m_Lock);
+}
+
+void DETCACHE::SetThresholds(int maxDistance, float aspectTolerance)
+{
+    if (maxDistance < 0 || maxDistance > 64 || aspectTolerance < 0.0f)
+        throw "cache threshold out of range";
+    m_nMaxDistance = maxDistance;
+    m_fAspectTolerance = aspectTolerance;
+}
+
+/******************************************************************************\
+*
+*   ComputeHash
+*
+*   Difference hash of an integral image: the image is cut into PHASH_COLS x
+*   PHASH_ROWS cells of (nearly) equal size, bit 8*row+col is set when cell
+*   col of the row has a lower mean than cell col+1. The means are compared
+*   as cross products of the sums and areas, so no division is needed.
+*
+\******************************************************************************/
+
+unsigned __int64 DETCACHE::ComputeHash(const I_IMAGE *pIImg)
+{
+    int width = pIImg->GetWidth();
+    int height = pIImg->GetHeight();
+    int x[PHASH_COLS+1], y[PHASH_ROWS+1];
+    for (int i=0; i<=PHASH_COLS; i++)
+        x[i] = i*width/PHASH_COLS;
+    for (int j=0; j<=PHASH_ROWS; j++)
+        y[j] = j*height/PHASH_ROWS;
+
+    unsigned __int64 hash = 0;
+    for (int j=0; j<PHASH_ROWS; j++)
+    {
+        unsigned int sum[PHASH_COLS];
+        for (int i=0; i<PHASH_COLS; i++)
+            sum[i] = (pIImg->GetValue(x[i+1], y[j+1]) - pIImg->GetValue(x[i], y[j+1]))
+                   - (pIImg->GetValue(x[i+1], y[j]) - pIImg->GetValue(x[i], y[j]));
+        for (int i=0; i<PHASH_COLS-1; i++)
+        {
+            __int64 a = (__int64)sum[i] * (x[i+2] - x[i+1]);
+            __int64 b = (__int64)sum[i+1] * (x[i+1] - x[i]);
+            if (a < b)
+                hash |= (unsigned __int64)1 << (j*(PHASH_COLS-1) + i);
+        }
+    }
+    return hash;
+}
+
+int DETCACHE::Distance(unsigned __int64 hashA, unsigned __int64 hashB)
+{
+    unsigned __int64 diff = hashA ^ hashB;
+    int count = 0;
+    for (; diff; count++)
+        diff &= diff - 1;       // clears the lowest bit set
+    return count;
+}
+
+// the recency list, m_nHead is the most recently used entry
+void DETCACHE::Unlink(int i)
+{
+    ENTRY &e = m_pEntries[i];
+    if (e.m_nPrev >= 0) m_pEntries[e.m_nPrev].m_nNext = e.m_nNext; else m_nHead = e.m_nNext;
+    if (e.m_nNext >= 0) m_pEntries[e.m_nNext].m_nPrev = e.m_nPrev; else m_nTail = e.m_nPrev;
+}
+
+void DETCACHE::LinkFront(int i)
+{
+    ENTRY &e = m_pEntries[i];
+    e.m_nPrev = -1;
+    e.m_nNext = m_nHead;
+    if (m_nHead >= 0) m_pEntries[m_nHead].m_nPrev = i; else m_nTail = i;
+    m_nHead = i;
+}
+
+// add an entry at the front, the least recently used one makes room when the cache is full.
+// m_Lock must be held
+void DETCACHE::Add(unsigned __int64 hash, int width, int height, const SCORED_RECT *pRc, int num)
+{
+    SCORED_RECT *pCopy = NULL;
+    if (num > 0)
+    {
+        pCopy = new SCORED_RECT [num];
+        if (!pCopy)
+            throw "out of memory";
+        memcpy(pCopy, pRc, num*sizeof(SCORED_RECT));
+    }
+
+    int i;
+    if (m_nCount < m_nCapacity)
+        i = m_nCount++;
+    else
+    {
+        i = m_nTail;
+        Unlink(i);
+        if (m_pEntries[i].m_pRect) delete []m_pEntries[i].m_pRect;
+    }
+    ENTRY &e = m_pEntries[i];
+    e.m_nHash = hash;
+    e.m_nWidth = width;
+    e.m_nHeight = height;
+    e.m_nNumRect = num;
+    e.m_pRect = pCopy;
+    LinkFront(i);
+}
+
+bool DETCACHE::Lookup(DETWORKSPACE *pWS, unsigned __int64 *pHash)
+{
+    IN_IMAGE *pIImg = &pWS->m_IImage;
+    int width = pIImg->GetWidth();
+    int height = pIImg->GetHeight();
+    unsigned __int64 hash = ComputeHash(pIImg);
+    *pHash = hash;
+
+    EnterThreadLock(&m_Lock);
+    // the closest match, the most recent one of those equally close
+    int best = -1, bestDistance = m_nMaxDistance+1;
+    float aspect = (float)width / height;
+    for (int i = m_nHead; i >= 0; i = m_pEntries[i].m_nNext)
+    {
+        const ENTRY &e = m_pEntries[i];
+        int distance = Distance(hash, e.m_nHash);
+        if (distance >= bestDistance)
+            continue;
+        float cachedAspect = (float)e.m_nWidth / e.m_nHeight;
+        if (fabs(aspect - cachedAspect) > m_fAspectTolerance * cachedAspect)
+            continue;
+        best = i;
+        bestDistance = distance;
+    }
+    if (best < 0)
+    {
+        m_nMisses ++;
+        LeaveThreadLock(&m_Lock);
+        return false;
+    }
+
+    const ENTRY &e = m_pEntries[best];
+    try
+    {
+        pWS->Reserve(e.m_nNumRect);
+    }
+    catch (...)
+    {
+        LeaveThreadLock(&m_Lock);
+        throw;
+    }
+    float scaleX = (float)width / e.m_nWidth;
+    float scaleY = (float)height / e.m_nHeight;
+    for (int k=0; k<e.m_nNumRect; k++)
+    {
+        const IRECT &src = e.m_pRect[k].m_rect;
+        IRECT &dst = pWS->m_pMergedDetRect[k].m_rect;
+        dst.m_ixMin = (int)(src.m_ixMin * scaleX + 0.5f);
+        dst.m_ixMax = (int)(src.m_ixMax * scaleX + 0.5f);
+        dst.m_iyMin = (int)(src.m_iyMin * scaleY + 0.5f);
+        dst.m_iyMax = (int)(src.m_iyMax * scaleY + 0.5f);
+        pWS->m_pMergedDetRect[k].m_score = e.m_pRect[k].m_score;
+    }
+    pWS->m_nNumMergedDetRect = e.m_nNumRect;
+    pWS->m_nNumRawDetRect = 0;
+    pWS->m_nTotalWindows = 0;
+    pWS->ClearMasks();      // the hit stands in for the scan that would have used them
+    Unlink(best);
+    LinkFront(best);
+    m_nHits ++;
+    LeaveThreadLock(&m_Lock);
+    return true;
+}
+
+void DETCACHE::Insert(DETWORKSPACE *pWS, unsigned __int64 hash)
+{
+    SCORED_RECT *pRc;
+    int num = pWS->GetDetResults(&pRc, true);
+    EnterThreadLock(&m_Lock);
+    try
+    {
+        Add(hash, pWS->m_IImage.GetWidth(), pWS->m_IImage.GetHeight(), pRc, num);
+    }
+    catch (...)
+    {
+        LeaveThreadLock(&m_Lock);
+        throw;
+    }
+    LeaveThreadLock(&m_Lock);
+}
+
+/******************************************************************************\
+*
+*   Cache file
+*
+*   Text, one image per line: the hash as 16 hex digits, the image width and
+*   height and the number of detections, followed by left, top, right,
+*   bottom and score of each detection.
+*
+\******************************************************************************/
+
+#define CACHE_FILE_TAG      "DETCACHE 1"
+
+void DETCACHE::Load(const char *fileName)
+{
+    FILE *fp = fopen(fileName, "r");
+    if (fp == NULL)
+        throw "Open file failed";
+
+    char tag[32];
+    int count;
+    if (!fgets(tag, sizeof(tag), fp) || strncmp(tag, CACHE_FILE_TAG, strlen(CACHE_FILE_TAG)) ||
+        fscanf(fp, "%d", &count) != 1 || count < 0)
+    {
+        fclose(fp);
+        throw "Invalid cache file";
+    }
+
+    Clear();
+    SCORED_RECT *pRc = NULL;
+    int maxRect = 0;
+    EnterThreadLock(&m_Lock);
+    try
+    {
+        for (int n=0; n<count; n++)
+        {
+            unsigned int hi, lo;
+            int width, height, num;
+            if (fscanf(fp, "%8x%8x %d %d %d", &hi, &lo, &width, &height, &num) != 5 ||
+                width <= 0 || height <= 0 || num < 0)
+                throw "Invalid cache file";
+            if (num > maxRect)
+            {
+                if (pRc) delete []pRc;
+                pRc = new SCORED_RECT [num];
+                if (!pRc)
+                    throw "out of memory";
+                maxRect = num;
+            }
+            for (int k=0; k<num; k++)
+            {
+                IRECT &rc = pRc[k].m_rect;
+                if (fscanf(fp, "%d %d %d %d %f", &rc.m_ixMin, &rc.m_iyMin, &rc.m_ixMax, &rc.m_iyMax,
+                           &pRc[k].m_score) != 5)
+                    throw "Invalid cache file";
+            }
+            Add(((unsigned __int64)hi << 32) | lo, width, height, pRc, num);
+        }
+    }
+    catch (...)
+    {
+        LeaveThreadLock(&m_Lock);
+        if (pRc) delete []pRc;
+        fclose(fp);
+        throw;
+    }
+    LeaveThreadLock(&m_Lock);
+    if (pRc) delete []pRc;
+    fclose(fp);
+}
+
+void DETCACHE::Save(const char *fileName)
+{
+    FILE *fp = fopen(fileName, "w");
+    if (fp == NULL)
+        throw "Open file failed";
+
+    EnterThreadLock(&m_Lock);
+    fprintf(fp, "%s\n%d\n", CACHE_FILE_TAG, m_nCount);
+    for (int i = m_nTail; i >= 0; i = m_pEntries[i].m_nPrev)
+    {
+        const ENTRY &e = m_pEntries[i];
+        fprintf(fp, "%08x%08x %d %d %d", (unsigned int)(e.m_nHash >> 32), (unsigned int)e.m_nHash,
+                e.m_nWidth, e.m_nHeight, e.m_nNumRect);
+        for (int k=0; k<e.m_nNumRect; k++)
+        {
+            const IRECT &rc = e.m_pRect[k].m_rect;
+            fprintf(fp, " %d %d %d %d %.9g", rc.m_ixMin, rc.m_iyMin, rc.m_ixMax, rc.m_iyMax,
+                    e.m_pRect[k].m_score);
+        }
+        fprintf(fp, "\n");
+    }
+    LeaveThreadLock(&m_Lock);
+    fclose(fp);
+}
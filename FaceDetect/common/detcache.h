@@ -0,0 +1,101 @@
+#pragma once
+
+/******************************************************************************\
+*
+*   DETCACHE
+*
+*       Remembers the merged detections of the images already scanned, keyed
+*       by a perceptual hash of the image, so that a re-upload, a resized copy
+*       or a thumbnail of a known photo gets its faces back without a scan.
+*
+*       The hash is a 64-bit difference hash: the image is reduced to
+*       PHASH_COLS x PHASH_ROWS box averages straight from the integral image
+*       (four lookups per cell), and each bit tells whether a cell is darker
+*       than its right neighbour. It doesn't change with the image size and
+*       hardly with recompression or a global brightness change. Two images
+*       match when their hashes differ in at most maxDistance bits and their
+*       aspect ratios agree within aspectTolerance, the detections of the
+*       cached one are then scaled to the size of the new one.
+*
+*       The cache holds at most capacity images and drops the least recently
+*       used one when it is full. Load() and Save() keep it in a text file
+*       between runs. All calls are safe from several threads at once.
+*
+*       Typical use:
+*
+*           unsigned __int64 hash;
+*           if (!cache.Lookup(&ws, &hash))
+*           {
+*               detector.DetectObject(&ws);
+*               cache.Insert(&ws, hash);
+*           }
+*
+\******************************************************************************/
+
+#include "detector.h"
+#include "threadpool.h"
+
+#define PHASH_COLS                          9       // one more than the bits of a row
+#define PHASH_ROWS                          8
+#define DEFAULT_CACHE_CAPACITY              1024    // images
+#define DEFAULT_CACHE_MAX_DISTANCE          6       // of the 64 hash bits
+#define DEFAULT_CACHE_ASPECT_TOLERANCE      0.02f
+
+class DETCACHE
+{
+    struct ENTRY
+    {
+        unsigned __int64    m_nHash;
+        int                 m_nWidth;       // size of the image the detections are for
+        int                 m_nHeight;
+        int                 m_nNumRect;
+        SCORED_RECT       * m_pRect;
+        int                 m_nPrev;        // recency list, -1 ends it
+        int                 m_nNext;
+    };
+
+    int             m_nCapacity;
+    int             m_nCount;
+    ENTRY         * m_pEntries;
+    int             m_nHead;                // most recently used
+    int             m_nTail;                // least recently used, the next to go
+    int             m_nMaxDistance;
+    float           m_fAspectTolerance;
+    int             m_nHits;
+    int             m_nMisses;
+    THREADLOCK      m_Lock;
+
+    void            Unlink(int i);
+    void            LinkFront(int i);
+    void            Add(unsigned __int64 hash, int width, int height, const SCORED_RECT *pRc, int num);
+
+public:
+    DETCACHE(int capacity = DEFAULT_CACHE_CAPACITY);
+    ~DETCACHE();
+    void            Clear();
+
+    static unsigned __int64 ComputeHash(const I_IMAGE *pIImg);
+    static int      Distance(unsigned __int64 hashA, unsigned __int64 hashB);
+
+    // an image matches a cached one with at most maxDistance different hash bits and
+    // width/height ratios within aspectTolerance of each other
+    void            SetThresholds(int maxDistance, float aspectTolerance);
+
+    // hash the workspace's integral image and look for a near duplicate. on a hit the
+    // cached detections, scaled to this image, become the merged results of pWS, the raw
+    // list is left empty and the masks set for the scan are dropped. *pHash receives the
+    // hash for Insert()
+    bool            Lookup(DETWORKSPACE *pWS, unsigned __int64 *pHash);
+    // remember the merged results of pWS, an image just scanned
+    void            Insert(DETWORKSPACE *pWS, unsigned __int64 hash);
+
+    // the file is read into the cache, entries beyond the capacity are dropped oldest first.
+    // Save() writes the cache, least recently used first
+    void            Load(const char *fileName);
+    void            Save(const char *fileName);
+
+    int             GetCount()      { return m_nCount; };
+    int             GetHits()       { return m_nHits; };
+    int             GetMisses()     { return m_nMisses; };
+    void            ResetCounters() { m_nHits = m_nMisses = 0; };
+};
@@ -5,7 +5,7 @@
 \******************************************************************************/
 
 #include "stdafx.h"
-#include <windows.h>
+#include "platform.h"
 #include <math.h>
 
 #ifndef _DETECTION_ONLY
@@ -14,6 +14,7 @@
 #endif
 
 #include "detector.h"
+#include "jpegdec.h"
 
 
 /******************************************************************************\
@@ -74,6 +75,16 @@ int compare_idirect(const void *arg1, const void *arg2)
         1 : ((((const ID_IRECT *)arg1)->rc->m_ixMin < ((const ID_IRECT *)arg2)->rc->m_ixMin) ? -1 : 0);
 }
 
+// detections by row, then by column 
+int compare_raster(const void *arg1, const void *arg2)
+{
+    const IRECT *rc1 = &((const SCORED_RECT *)arg1)->m_rect; 
+    const IRECT *rc2 = &((const SCORED_RECT *)arg2)->m_rect; 
+    if (rc1->m_iyMin != rc2->m_iyMin) 
+        return rc1->m_iyMin > rc2->m_iyMin ? 1 : -1; 
+    return rc1->m_ixMin > rc2->m_ixMin ? 1 : (rc1->m_ixMin < rc2->m_ixMin ? -1 : 0); 
+}
+
 /// Checks for rectangle overlap and links the two rectangles if they do.
 void MERGERECT::_RectangleOverlapHelper(ID_IRECT* group, int n_srcs, double requiredOverlap)
 {
@@ -187,6 +198,138 @@ void MERGERECT::MergeRectangles(IRECT** srcs, int n_srcs,
 }
 
 
+/******************************************************************************\
+*
+*   Member functions for the DETWORKSPACE class
+*
+\******************************************************************************/
+
+DETWORKSPACE::DETWORKSPACE() :
+    m_pIImg(NULL),
+    m_nTotalWindows(0),
+    m_nMaxNumDetRect(0),
+    m_nNumRawDetRect(0),
+    m_pRawDetRect(NULL),
+    m_nNumMergedDetRect(0),
+    m_pMergedDetRect(NULL),
+    m_pScratch(NULL),
+    m_nMaxDenseWindows(0),
+    m_pDenseIdx(NULL),
+    m_pDenseNorm(NULL),
+    m_pDenseScore(NULL),
+    m_pDenseValue(NULL),
+    m_pSkipRows(NULL),
+    m_bSkinMask(false),
+    m_bRegionMask(false),
+    m_pSkinGate(NULL),
+    m_pRegionGate(NULL),
+    m_nNumStages(0),
+    m_nScanStages(0),
+    m_fScanScoreTh(0.0f),
+    m_nMaxPruneCount(0),
+    m_pnPruneCount(NULL),
+    m_pnPrePruneCount(NULL)
+{
+    m_IImage.SetCompactNorm(true);      // the detector only needs ComputeNorm() 
+}
+
+DETWORKSPACE::~DETWORKSPACE()
+{
+    if (m_pRawDetRect) { delete []m_pRawDetRect; m_pRawDetRect = NULL; }
+    if (m_pMergedDetRect) { delete []m_pMergedDetRect; m_pMergedDetRect = NULL; }
+    if (m_pScratch) { delete m_pScratch; m_pScratch = NULL; }
+    if (m_pDenseIdx) { delete []m_pDenseIdx; m_pDenseIdx = NULL; }
+    if (m_pDenseNorm) { delete []m_pDenseNorm; m_pDenseNorm = NULL; }
+    if (m_pDenseScore) { delete []m_pDenseScore; m_pDenseScore = NULL; }
+    if (m_pDenseValue) { delete []m_pDenseValue; m_pDenseValue = NULL; }
+    if (m_pSkipRows) { delete []m_pSkipRows; m_pSkipRows = NULL; }
+    if (m_pnPruneCount) { delete []m_pnPruneCount; m_pnPruneCount = NULL; }
+    if (m_pnPrePruneCount) { delete []m_pnPrePruneCount; m_pnPrePruneCount = NULL; }
+}
+
+void DETWORKSPACE::Reserve(int maxNumDetRect)
+{
+    if (m_nMaxNumDetRect >= maxNumDetRect) 
+        return; 
+
+    if (m_pRawDetRect) { delete []m_pRawDetRect; m_pRawDetRect = NULL; }
+    if (m_pMergedDetRect) { delete []m_pMergedDetRect; m_pMergedDetRect = NULL; }
+    m_nMaxNumDetRect = 0; 
+    m_nNumRawDetRect = 0; 
+    m_nNumMergedDetRect = 0; 
+    m_pRawDetRect = new SCORED_RECT [maxNumDetRect]; 
+    m_pMergedDetRect = new SCORED_RECT [maxNumDetRect]; 
+    if (!m_pRawDetRect || !m_pMergedDetRect)
+        throw "out of memory"; 
+    m_nMaxNumDetRect = maxNumDetRect; 
+}
+
+void DETWORKSPACE::ReserveDense(int numWindows)
+{
+    if (m_nMaxDenseWindows >= numWindows) 
+        return; 
+
+    if (m_pDenseIdx) { delete []m_pDenseIdx; m_pDenseIdx = NULL; }
+    if (m_pDenseNorm) { delete []m_pDenseNorm; m_pDenseNorm = NULL; }
+    if (m_pDenseScore) { delete []m_pDenseScore; m_pDenseScore = NULL; }
+    if (m_pDenseValue) { delete []m_pDenseValue; m_pDenseValue = NULL; }
+    if (m_pSkipRows) { delete []m_pSkipRows; m_pSkipRows = NULL; }
+    m_nMaxDenseWindows = 0; 
+    m_pDenseIdx = new int [numWindows]; 
+    m_pDenseNorm = new float [numWindows]; 
+    m_pDenseScore = new float [numWindows]; 
+    m_pDenseValue = new float [numWindows]; 
+    m_pSkipRows = new int [numWindows]; 
+    m_nMaxDenseWindows = numWindows; 
+}
+
+// zero the prune counts for a scan with up to numClassifiers in a cascade 
+void DETWORKSPACE::ResetPruneCount(int numClassifiers)
+{
+#if defined(COUNT_PRUNE_EFFECT)
+    if (m_nMaxPruneCount < numClassifiers) 
+    {
+        if (m_pnPruneCount) { delete []m_pnPruneCount; m_pnPruneCount = NULL; }
+        if (m_pnPrePruneCount) { delete []m_pnPrePruneCount; m_pnPrePruneCount = NULL; }
+        m_nMaxPruneCount = 0; 
+        m_pnPruneCount = new __int64 [numClassifiers]; 
+        m_pnPrePruneCount = new __int64 [numClassifiers]; 
+        m_nMaxPruneCount = numClassifiers; 
+    }
+    memset(m_pnPruneCount, 0, m_nMaxPruneCount*sizeof(__int64)); 
+    memset(m_pnPrePruneCount, 0, m_nMaxPruneCount*sizeof(__int64)); 
+#endif
+}
+
+void DETWORKSPACE::SetSkinMask(const BYTE *pData, int width, int height, int stride, PIXEL_FORMAT format)
+{
+    m_bSkinMask = false; 
+    if (format == PIXFMT_GRAY8) 
+        return; 
+    m_SkinIImg.InitSkinMask(pData, width, height, stride, format); 
+    m_bSkinMask = true; 
+}
+
+void DETWORKSPACE::SetRegionMask(const IMAGE *pMask)
+{
+    m_RegionIImg.Init(pMask); 
+    m_bRegionMask = true; 
+}
+
+int DETWORKSPACE::GetDetResults(SCORED_RECT **ppRc, bool merged)
+{
+    if (merged) 
+    {
+        *ppRc = m_pMergedDetRect; 
+        return m_nNumMergedDetRect; 
+    }
+    else
+    {
+        *ppRc = m_pRawDetRect; 
+        return m_nNumRawDetRect; 
+    }
+}
+
 /******************************************************************************\
 *
 *
@@ -202,21 +345,28 @@ DETECTOR::DETECTOR(const char *fileName,
 	m_bRejAtNodes = true;
     m_bValid = false; 
     m_nClassifiers = 0; 
+    m_nTransform = 0; 
+    m_nLookupStages = 0; 
+    m_nDenseStages = DEFAULT_DENSE_STAGES; 
+    m_nMaxSkip = 0; 
+    m_fSkipMargin = DEFAULT_SKIP_MARGIN; 
+    m_bSkipRows = false; 
+    m_pPrefilter = NULL; 
+    m_fSkinFraction = DEFAULT_SKIN_FRACTION; 
+    m_pfTruncScoreTh = NULL; 
     m_fStepSize = stepSize; 
     m_fStepScale = stepScale; 
 
     m_nMaxNumRawDetRect = maxNumRawDetRect; 
-    m_pRawDetRect = new SCORED_RECT [maxNumRawDetRect]; 
-    m_pMergedDetRect = new SCORED_RECT [maxNumRawDetRect]; 
-    if (!m_pRawDetRect || !m_pMergedDetRect)
-        throw "out of memory"; 
+    m_Workspace.Reserve(maxNumRawDetRect); 
 
     CLASSIFIER *pOriClassifiers = CLASSIFIER::ReadClassifierFile(&m_nClassifiers, 
                                                                  &m_nBaseWidth,  
                                                                  &m_nBaseHeight, 
                                                                  &m_nNumFeatureTh, 
                                                                  &m_fFinalScoreTh, 
-                                                                 fileName); 
+                                                                 fileName, 
+                                                                 &m_pfTruncScoreTh); 
 
     if (pOriClassifiers)
     {
@@ -237,11 +387,14 @@ DETECTOR::DETECTOR(const char *fileName,
     }
     else
         throw "out of memory"; 
+    SetTileCache(DEFAULT_TILE_CACHE); 
+    SetSkinGate(DEFAULT_SKIN_FRACTION); 
 
 #if defined(COUNT_PRUNE_EFFECT)
     m_pnPruneCount = new __int64 [m_nClassifiers]; 
     for (int i=0; i<m_nClassifiers; i++) 
         m_pnPruneCount[i] = 0; 
+    InitThreadLock(&m_PruneLock); 
 #endif
 
 	// if(record_Features) pre-allocate memory.
@@ -262,16 +415,94 @@ DETECTOR::DETECTOR(const char *fileName,
 		m_raw = m_thresh = NULL;
 }
 
+DETECTOR::DETECTOR(const DETECTOR *pSrc, int transform)
+{
+    if (pSrc == NULL || !pSrc->m_bValid) 
+        throw "Invalid detector"; 
+    if (transform <= 0 || transform > (CASCADE_MIRROR | CASCADE_ROTATION_MASK)) 
+        throw "Unknown cascade transform"; 
+    bool bMirror = (transform & CASCADE_MIRROR) != 0; 
+    int rotation = (transform & CASCADE_ROTATION_MASK) >> 1;    // quarter turns 
+    bool bSwap = (rotation & 1) != 0; 
+
+    m_bRejAtNodes = pSrc->m_bRejAtNodes; 
+    m_bValid = false; 
+    m_nClassifiers = pSrc->m_nClassifiers; 
+    m_fStepSize = pSrc->m_fStepSize; 
+    m_fStepScale = pSrc->m_fStepScale; 
+    m_nBaseWidth = bSwap ? pSrc->m_nBaseHeight : pSrc->m_nBaseWidth; 
+    m_nBaseHeight = bSwap ? pSrc->m_nBaseWidth : pSrc->m_nBaseHeight; 
+    m_nNumFeatureTh = pSrc->m_nNumFeatureTh; 
+    m_fFinalScoreTh = pSrc->m_fFinalScoreTh; 
+    m_pfTruncScoreTh = new float [m_nClassifiers+1]; 
+    memcpy(m_pfTruncScoreTh, pSrc->m_pfTruncScoreTh, (m_nClassifiers+1)*sizeof(float)); 
+
+    // the new transform is applied after the one pSrc carries, a mirror reverses 
+    // the direction of the earlier rotation 
+    int srcRotation = (pSrc->m_nTransform & CASCADE_ROTATION_MASK) >> 1; 
+    int totalRotation = (rotation + (bMirror ? 4-srcRotation : srcRotation)) & 3; 
+    m_nTransform = ((pSrc->m_nTransform ^ transform) & CASCADE_MIRROR) | (totalRotation << 1); 
+
+    m_nMaxNumRawDetRect = pSrc->m_nMaxNumRawDetRect; 
+    m_Workspace.Reserve(m_nMaxNumRawDetRect); 
+
+    for (int i=0; i<MAX_NUM_SCALE; i++) 
+        m_ClassifierArray[i] = NULL; 
+    for (int i=0; i<MAX_NUM_SCALE; i++) 
+    {
+        m_nWidth[i] = bSwap ? pSrc->m_nHeight[i] : pSrc->m_nWidth[i]; 
+        m_nHeight[i] = bSwap ? pSrc->m_nWidth[i] : pSrc->m_nHeight[i]; 
+        m_nStepW[i] = bSwap ? pSrc->m_nStepH[i] : pSrc->m_nStepW[i]; 
+        m_nStepH[i] = bSwap ? pSrc->m_nStepW[i] : pSrc->m_nStepH[i]; 
+
+        // transform each scale inside the window it is scanned with, so the result 
+        // is the exact mirror or rotation of the scaled source cascade 
+        m_ClassifierArray[i] = CLASSIFIER::CreateScaledClassifierArray(pSrc->m_ClassifierArray[i], m_nClassifiers, 1.0f); 
+        for (int j=0; j<m_nClassifiers; j++) 
+        {
+            FEATURE &feature = m_ClassifierArray[i][j].m_Feature; 
+            if (feature.m_nType == FEATURE::RECTFEATURE) 
+                feature.m_pF.pRCF->InitTransform(pSrc->m_ClassifierArray[i][j].m_Feature.m_pF.pRCF, 
+                                                 pSrc->m_nWidth[i], pSrc->m_nHeight[i], bMirror, rotation); 
+        }
+    }
+    m_bValid = true; 
+
+#if defined(COUNT_PRUNE_EFFECT)
+    m_pnPruneCount = new __int64 [m_nClassifiers]; 
+    for (int i=0; i<m_nClassifiers; i++) 
+        m_pnPruneCount[i] = 0; 
+    InitThreadLock(&m_PruneLock); 
+#endif
+
+    m_record_Features = false; 
+    m_raw = m_thresh = NULL; 
+
+    m_nDenseStages = pSrc->m_nDenseStages; 
+    m_nMaxSkip = pSrc->m_nMaxSkip; 
+    m_fSkipMargin = pSrc->m_fSkipMargin; 
+    m_bSkipRows = pSrc->m_bSkipRows; 
+    SetTileCache(pSrc->m_nTileCache); 
+    SetSkinGate(pSrc->m_fSkinFraction); 
+    m_pPrefilter = pSrc->m_pPrefilter ? new DETECTOR(pSrc->m_pPrefilter, transform) : NULL; 
+    m_nLookupStages = 0; 
+    SetSharedLookupStages(pSrc->m_nLookupStages); 
+}
+
 DETECTOR::~DETECTOR()
 {
     Release(); 
+#if defined(COUNT_PRUNE_EFFECT)
+    DeleteThreadLock(&m_PruneLock); 
+#endif
 }
 
 void DETECTOR::Release()
 {
     m_bValid = false; 
-    if (m_pRawDetRect) { delete []m_pRawDetRect; m_pRawDetRect = NULL; }
-    if (m_pMergedDetRect) { delete []m_pMergedDetRect; m_pMergedDetRect = NULL; }
+
+    if (m_pPrefilter) { delete m_pPrefilter; m_pPrefilter = NULL; }
+    if (m_pfTruncScoreTh) { delete []m_pfTruncScoreTh; m_pfTruncScoreTh = NULL; }
 
     for (int i=0; i<MAX_NUM_SCALE; i++) 
         CLASSIFIER::DeleteClassifierArray(m_ClassifierArray[i]);
@@ -296,28 +527,33 @@ void DETECTOR::Release()
 *
 \******************************************************************************/
 
-bool DETECTOR::Classify (IRECT *rc, int nScale, float *score)
+// run the classifiers [first, last) on the window, adding to *pScore. returns the classifier 
+// the window was rejected at, or last if it passed them all 
+int DETECTOR::EvalStages (I_IMAGE *pIImg, IRECT *rc, int nScale, float norm, int first, int last, float *pScore)
 {
-    ASSERT (nScale >= 0 && nScale < MAX_NUM_SCALE); 
-
-    float value, wScore = 0.0f;
+    float value, wScore = *pScore;
     CLASSIFIER * pC = m_ClassifierArray[nScale]; 
     int i, j; 
 
-#if defined(COUNT_PRUNE_EFFECT)
-    bool bPruned = false; 
-#endif
+    // the shared lookups assume every classifier before is evaluated in the same call 
+    SHAREDLOOKUP *pLookup = &m_SharedLookup[nScale]; 
+    int numShared = (first == 0) ? pLookup->m_nFeatures : 0; 
+    unsigned int corners[MAX_SHARED_CORNERS]; 
+    float sums[MAX_SHARED_RECTS]; 
 
-    float norm = m_IImg->ComputeNorm(rc); 
-    for (i=0; i<m_nClassifiers; i++) 
+    for (i=first; i<last; i++) 
     {
         switch(pC[i].m_Feature.m_nType) 
         {
         case FEATURE::RECTFEATURE:
-            value = pC[i].m_Feature.m_pF.pRCF->Eval(m_IImg, norm, rc->m_ixMin, rc->m_iyMin); 
+            if (i < numShared) 
+                value = pLookup->Eval(i, pIImg->GetDataPtr(), pIImg->GetIWidth(), norm, rc->m_ixMin, rc->m_iyMin, 
+                                      corners, sums); 
+            else
+                value = pC[i].m_Feature.m_pF.pRCF->Eval(pIImg, norm, rc->m_ixMin, rc->m_iyMin); 
             break; 
         case FEATURE::NORMFEATURE: 
-            value = pC[i].m_Feature.Eval(m_IImg, norm); 
+            value = pC[i].m_Feature.Eval(pIImg, norm); 
             break; 
         default:
             throw "Unknown feature"; 
@@ -372,23 +608,131 @@ bool DETECTOR::Classify (IRECT *rc, int nScale, float *score)
         }
         if (j == pC[i].m_nNumTh) wScore += pScore[j]; 
         if (m_bRejAtNodes && wScore < pC[i].GetMinPosScoreTh()) 
+            break; 
+    }
+
+    *pScore = wScore; 
+    return i; 
+}
+
+bool DETECTOR::Classify (DETWORKSPACE *pWS, IRECT *rc, int nScale, float *score, int *pSkip, 
+                         I_IMAGE *pHalfIImg)
+{
+    ASSERT (nScale >= 0 && nScale < MAX_NUM_SCALE); 
+
+    IN_IMAGE *pIImg = pWS->m_pIImg; 
+    float wScore = 0.0f;
+    float norm = pIImg->ComputeNorm(rc); 
+    int first = 0; 
+
+    if (pHalfIImg) 
+    {
+        // the prefilter's window at half the position, it takes the norm of the full window 
+        DETECTOR *pPre = m_pPrefilter; 
+        IRECT half; 
+        half.Reset(rc->m_ixMin >> 1, rc->m_iyMin >> 1, pPre->m_nWidth[nScale], pPre->m_nHeight[nScale]); 
+        if (half.m_ixMax <= pHalfIImg->GetWidth() && half.m_iyMax <= pHalfIImg->GetHeight()) 
         {
+            int n = pPre->EvalStages(pHalfIImg, &half, nScale, norm, 0, pPre->m_nClassifiers, &wScore); 
+            if (n < pPre->m_nClassifiers) 
+            {
 #if defined(COUNT_PRUNE_EFFECT)
-            bPruned = true; 
-            m_pnPruneCount[i] += 1; 
+                pWS->m_pnPrePruneCount[n] += 1; 
 #endif
-            break; 
+                // the prefilter's thresholds are lowered by the slack, the skip goes by its own 
+                *score = wScore; 
+                if (pSkip) 
+                    *pSkip = SkipSteps(n, pPre->m_ClassifierArray[nScale][n].GetMinPosScoreTh() - wScore); 
+                return false; 
+            }
+            // the window goes on after the stages the prefilter stands for, with its score 
+            first = pPre->m_nClassifiers; 
         }
     }
 
+    int numStages = pWS->m_nScanStages; 
+    int i = EvalStages(pIImg, rc, nScale, norm, min(first, numStages), numStages, &wScore); 
+
 #if defined(COUNT_PRUNE_EFFECT)
-    if (!bPruned)
-        m_pnPruneCount[m_nClassifiers-1] += 1; 
+    pWS->m_pnPruneCount[min(i, m_nClassifiers-1)] += 1; 
 #endif
 
     *score = wScore; 
+    if (pSkip) 
+        *pSkip = i < numStages ? SkipSteps(i, m_ClassifierArray[nScale][i].GetMinPosScoreTh() - wScore) : 0; 
+
+    return (i==numStages) && (wScore > pWS->m_fScanScoreTh); 
+}
+
+void DETECTOR::SetTileCache(int cacheBytes)
+{
+    m_nTileCache = max(cacheBytes, 0); 
+    for (int i=0; i<MAX_NUM_SCALE; i++) 
+    {
+        m_nTileCols[i] = 0; 
+        if (m_nTileCache > 0) 
+        {
+            // the strip covers (tileCols-1)*stepW + width pixels of winH rows 
+            int stripWidth = m_nTileCache / (TILE_BYTES_PER_PIXEL * m_nHeight[i]); 
+            m_nTileCols[i] = max((stripWidth - m_nWidth[i]) / m_nStepW[i] + 1, 1); 
+        }
+    }
+}
+
+void DETECTOR::SetSkinGate(float minFraction)
+{
+    if (minFraction > 1.0f) 
+        throw "skin fraction out of range"; 
+    m_fSkinFraction = max(minFraction, 0.0f); 
+    for (int i=0; i<MAX_NUM_SCALE; i++) 
+        m_nMinSkin[i] = (unsigned int)ceil(m_fSkinFraction * m_nWidth[i] * m_nHeight[i]); 
+}
+
+void DETECTOR::SetPrefilter(const char *fileName)
+{
+    DETECTOR *pPrefilter = NULL; 
+    if (fileName) 
+    {
+        pPrefilter = new DETECTOR(fileName, m_fStepSize, m_fStepScale, 1); 
+        // a derived detector gets a prefilter derived the same way 
+        if (m_nTransform) 
+        {
+            DETECTOR *pSrc = pPrefilter; 
+            pPrefilter = new DETECTOR(pSrc, m_nTransform); 
+            delete pSrc; 
+        }
+        if (abs(2*pPrefilter->m_nBaseWidth - m_nBaseWidth) > 1 || 
+            abs(2*pPrefilter->m_nBaseHeight - m_nBaseHeight) > 1) 
+        {
+            delete pPrefilter; 
+            throw "the prefilter must have half the base window"; 
+        }
+        if (pPrefilter->m_nClassifiers > m_nClassifiers) 
+        {
+            delete pPrefilter; 
+            throw "the prefilter has more classifiers than the cascade"; 
+        }
+    }
+    if (m_pPrefilter) 
+        delete m_pPrefilter; 
+    m_pPrefilter = pPrefilter; 
+}
 
-    return (i==m_nClassifiers) && (wScore > m_fFinalScoreTh); 
+void DETECTOR::SetAdaptiveStep(int maxSkip, float margin, bool bSkipRows)
+{
+    if (maxSkip > 0 && margin <= 0.0f) 
+        throw "skip margin must be positive"; 
+    m_nMaxSkip = max(maxSkip, 0); 
+    m_fSkipMargin = margin; 
+    m_bSkipRows = bSkipRows; 
+}
+
+// number of windows to skip after one rejected at stage, shortfall below the stage's minimum 
+int DETECTOR::SkipSteps (int stage, float shortfall)
+{
+    if (m_nMaxSkip == 0 || stage >= min(m_nClassifiers, ADAPTIVE_STEP_STAGES)) 
+        return 0; 
+    return min((int)(shortfall / m_fSkipMargin), m_nMaxSkip); 
 }
 
 
@@ -443,12 +787,74 @@ bool DETECTOR::Classify (IRECT *rc, int nScale, float *score)
 //}
 
 
-void DETECTOR::SetPruneMinPosThreshold (IRECT *rc, int nScale)
+void DETECTOR::SetSharedLookupStages(int numStages)
+{
+    numStages = max(min(numStages, m_nClassifiers), 0); 
+    RCFEATURE **ppFeatures = new RCFEATURE * [max(numStages, 1)]; 
+    for (int s=0; s<MAX_NUM_SCALE; s++) 
+    {
+        for (int i=0; i<numStages; i++) 
+        {
+            FEATURE &feature = m_ClassifierArray[s][i].m_Feature; 
+            ppFeatures[i] = feature.m_nType == FEATURE::RECTFEATURE ? feature.m_pF.pRCF : NULL; 
+        }
+        m_SharedLookup[s].Init(ppFeatures, numStages); 
+    }
+    delete []ppFeatures; 
+    m_nLookupStages = numStages; 
+}
+
+int DETECTOR::GetLookups(int stage, bool bShared)
+{
+    if (stage < 0 || stage >= m_nClassifiers) 
+        return 0; 
+    if (stage < m_SharedLookup[0].m_nFeatures) 
+        return m_SharedLookup[0].GetLookups(stage, bShared); 
+    FEATURE &feature = m_ClassifierArray[0][stage].m_Feature; 
+    return feature.m_nType == FEATURE::RECTFEATURE ? 4*feature.m_pF.pRCF->m_nRects : 0; 
+}
+
+float DETECTOR::GetTruncScoreTh(int numStages)
+{
+    if (numStages <= 0 || numStages >= m_nClassifiers || m_pfTruncScoreTh[numStages] == -FLT_MAX) 
+        return m_fFinalScoreTh; 
+    return m_pfTruncScoreTh[numStages]; 
+}
+
+void DETECTOR::SetTruncScoreTh(int numStages, float th)
+{
+    if (numStages <= 0 || numStages > m_nClassifiers) 
+        throw "number of stages out of range"; 
+    if (numStages == m_nClassifiers) 
+        m_fFinalScoreTh = th; 
+    else
+        m_pfTruncScoreTh[numStages] = th; 
+}
+
+int DETECTOR::StagesWithinBudget(int lookups)
+{
+    bool bCalibrated = false; 
+    for (int n=1; n<m_nClassifiers && !bCalibrated; n++) 
+        bCalibrated = m_pfTruncScoreTh[n] > -FLT_MAX; 
+
+    int best = 1, total = 0; 
+    for (int n=1; n<=m_nClassifiers; n++) 
+    {
+        total += GetLookups(n-1, true); 
+        if (total > lookups) 
+            break; 
+        if (!bCalibrated || n == m_nClassifiers || m_pfTruncScoreTh[n] > -FLT_MAX) 
+            best = n; 
+    }
+    return best; 
+}
+
+void DETECTOR::SetPruneMinPosThreshold (IN_IMAGE *pIImg, IRECT *rc, int nScale)
 {
     ASSERT (nScale >= 0 && nScale < MAX_NUM_SCALE); 
 
     float value, wScore = 0.0f;
-    float norm = m_IImg->ComputeNorm(rc); 
+    float norm = pIImg->ComputeNorm(rc); 
     CLASSIFIER * pC = m_ClassifierArray[nScale]; 
     int i, j; 
     bool bPruned = false; 
@@ -457,7 +863,7 @@ void DETECTOR::SetPruneMinPosThreshold (IRECT *rc, int nScale)
         switch(pC[i].m_Feature.m_nType) 
         {
         case FEATURE::RECTFEATURE:
-            value = pC[i].m_Feature.m_pF.pRCF->Eval(m_IImg, norm, rc->m_ixMin, rc->m_iyMin); 
+            value = pC[i].m_Feature.m_pF.pRCF->Eval(pIImg, norm, rc->m_ixMin, rc->m_iyMin); 
             break; 
         default:
             throw "Unknown feature"; 
@@ -482,48 +888,424 @@ void DETECTOR::SetPruneMinPosThreshold (IRECT *rc, int nScale)
 }
 
 void DETECTOR::DetectObject (IN_IMAGE* pIImg, int minScale, int maxScale)
+{
+    m_Workspace.m_pIImg = pIImg; 
+    ScanWindows(&m_Workspace, minScale, maxScale, m_nMaxNumRawDetRect); 
+    MergeRawDetRect(&m_Workspace); 
+}
+
+void DETECTOR::DetectObject (DETWORKSPACE* pWS, int minScale, int maxScale)
+{
+    ScanObject(pWS, minScale, maxScale); 
+    MergeRawDetRect(pWS); 
+}
+
+void DETECTOR::ScanObject (DETWORKSPACE* pWS, int minScale, int maxScale, int maxNumRawDetRect)
+{
+    pWS->m_pIImg = &pWS->m_IImage; 
+    ScanWindows(pWS, minScale, maxScale, maxNumRawDetRect > 0 ? maxNumRawDetRect : m_nMaxNumRawDetRect); 
+}
+
+// fill the raw result list of pWS from the image pWS->m_pIImg, nothing is merged 
+void DETECTOR::ScanWindows (DETWORKSPACE *pWS, int minScale, int maxScale, int maxNumRawDetRect)
 {
     ASSERT(m_bValid); 
     if (minScale < 0 || maxScale >= MAX_NUM_SCALE || minScale > maxScale)
         throw "scale out of range"; 
 
-    // copy the pointers 
-    m_IImg = pIImg; 
+    pWS->Reserve(maxNumRawDetRect); 
+    pWS->ResetPruneCount(m_pPrefilter ? max(m_nClassifiers, m_pPrefilter->m_nClassifiers) : m_nClassifiers); 
+    IN_IMAGE *pIImg = pWS->m_pIImg; 
+    SCORED_RECT *pRawDetRect = pWS->m_pRawDetRect; 
 
     int width = pIImg->GetWidth(); 
     int height = pIImg->GetHeight(); 
-    m_nNumRawDetRect = 0; 
+    int numRawDetRect = 0; 
+
+    // the prefilter looks at the integral image subsampled by 2 
+    I_IMAGE *pHalfIImg = NULL; 
+    if (m_pPrefilter && width >= 2 && height >= 2) 
+    {
+        pHalfIImg = &pWS->m_HalfIImg; 
+        pHalfIImg->Realloc(width/2, height/2); 
+        pHalfIImg->InitWithSubSample(pIImg, 0, 0, 2.0f); 
+    }
+
+    // the skin and region masks go with this scan only 
+    pWS->m_pSkinGate = NULL; 
+    pWS->m_pRegionGate = NULL; 
+    if (m_fSkinFraction > 0.0f && pWS->m_bSkinMask) 
+        pWS->m_pSkinGate = &pWS->m_SkinIImg; 
+    if (pWS->m_bRegionMask) 
+        pWS->m_pRegionGate = &pWS->m_RegionIImg; 
+    pWS->m_bSkinMask = false; 
+    pWS->m_bRegionMask = false; 
+    if ((pWS->m_pSkinGate && (pWS->m_pSkinGate->GetWidth() != width || pWS->m_pSkinGate->GetHeight() != height)) || 
+        (pWS->m_pRegionGate && (pWS->m_pRegionGate->GetWidth() != width || pWS->m_pRegionGate->GetHeight() != height))) 
+        throw "the mask doesn't match the image"; 
+    bool bGated = pWS->m_pSkinGate || pWS->m_pRegionGate; 
+
+    // a truncated cascade ends with the threshold calibrated for it 
+    int numStages = pWS->m_nNumStages > 0 ? min(pWS->m_nNumStages, m_nClassifiers) : m_nClassifiers; 
+    pWS->m_nScanStages = numStages; 
+    pWS->m_fScanScoreTh = GetTruncScoreTh(numStages); 
 
     bool bCont = true; 
-	m_nTotalWindows = 0;
+	int totalWindows = 0;
     for (int nScale = minScale; nScale <= maxScale && bCont; nScale++) 
     {
-        IRECT rect (0, m_nWidth[nScale], 0, m_nHeight[nScale]); 
-        while (rect.m_iyMax <= height && bCont) 
+        int winW = m_nWidth[nScale]; 
+        int winH = m_nHeight[nScale]; 
+        int stepW = m_nStepW[nScale]; 
+        if (winW > width || winH > height) 
+            continue; 
+        int numCols = (width - winW) / stepW + 1; 
+        int tileCols = m_nTileCols[nScale] > 0 ? min(m_nTileCols[nScale], numCols) : numCols; 
+        int firstRaw = numRawDetRect; 
+
+        int *pSkipRows = NULL; 
+        if (m_nMaxSkip > 0 && m_bSkipRows) 
+        {
+            pWS->ReserveDense(numCols); 
+            pSkipRows = pWS->m_pSkipRows; 
+        }
+
+        // the columns are scanned in strips of tileCols windows, each strip top to bottom. if the 
+        // raw list fills up the scale starts over across the whole width, so the list is cut where 
+        // the raster scan cuts it 
+        for (;;) 
         {
-            while (rect.m_ixMax <= width  && bCont) 
+            if (pSkipRows) 
+                memset(pSkipRows, 0, numCols*sizeof(int)); 
+            for (int firstCol = 0; firstCol < numCols && bCont; firstCol += tileCols) 
             {
-                float score; 
-				m_nTotalWindows ++;
-                if (Classify(&rect, nScale, &score)) 
+                int lastCol = min(firstCol + tileCols, numCols); 
+                for (int y = 0; y + winH <= height && bCont; y += m_nStepH[nScale]) 
                 {
-                    m_pRawDetRect[m_nNumRawDetRect].m_rect.Reset((float)rect.m_ixMin, (float)rect.m_iyMin, 
-                        (float)(rect.m_ixMax-rect.m_ixMin), (float)(rect.m_iyMax-rect.m_iyMin)); 
-                    m_pRawDetRect[m_nNumRawDetRect++].m_score = score; 
-                    if (m_nNumRawDetRect >= m_nMaxNumRawDetRect) 
-                        bCont = false; 
+                    if (m_nDenseStages > 0 && m_nMaxSkip == 0) 
+                    {
+                        bCont = ScanRowDense(pWS, nScale, y, firstCol, lastCol, pHalfIImg, &numRawDetRect, &totalWindows, 
+                                             maxNumRawDetRect); 
+                        continue; 
+                    }
+
+                    int col = firstCol; 
+                    while (col < lastCol && bCont) 
+                    {
+                        int skip = 0; 
+                        if (pSkipRows && pSkipRows[col] > 0) 
+                            pSkipRows[col] --; 
+                        else if (bGated && !PassGates(pWS, nScale, col*stepW, y)) 
+                        {
+                            if (pSkipRows) 
+                                pSkipRows[col] = 0; 
+                        }
+                        else 
+                        {
+                            IRECT rect; 
+                            float score; 
+                            rect.Reset(col*stepW, y, winW, winH); 
+                            totalWindows ++;
+                            if (Classify(pWS, &rect, nScale, &score, &skip, pHalfIImg)) 
+                            {
+                                pRawDetRect[numRawDetRect].m_rect.Reset((float)rect.m_ixMin, (float)rect.m_iyMin, 
+                                    (float)winW, (float)winH); 
+                                pRawDetRect[numRawDetRect++].m_score = score; 
+                                if (numRawDetRect >= maxNumRawDetRect) 
+                                    bCont = false; 
+                            }
+                            if (pSkipRows) 
+                                pSkipRows[col] = skip; 
+                        }
+                        col += 1 + skip; 
+                    }
                 }
-                rect.m_ixMin += m_nStepW[nScale]; 
-                rect.m_ixMax = rect.m_ixMin + m_nWidth[nScale]; 
             }
-            rect.m_iyMin += m_nStepH[nScale]; 
-            rect.m_iyMax = rect.m_iyMin + m_nHeight[nScale]; 
-            rect.m_ixMin = 0; 
-            rect.m_ixMax = m_nWidth[nScale]; 
+            if (bCont || tileCols == numCols) 
+                break; 
+            numRawDetRect = firstRaw; 
+            tileCols = numCols; 
+            bCont = true; 
         }
+
+        // put the detections of the strips back in raster order, the merge depends on it 
+        if (tileCols < numCols) 
+            qsort(pRawDetRect + firstRaw, numRawDetRect - firstRaw, sizeof(SCORED_RECT), compare_raster); 
     }
 
-    MergeRawDetRect(); 
+    pWS->m_nNumRawDetRect = numRawDetRect; 
+    pWS->m_nTotalWindows = totalWindows; 
+#if defined(COUNT_PRUNE_EFFECT)
+    AddPruneCount(pWS->m_pnPruneCount); 
+    if (m_pPrefilter) 
+        m_pPrefilter->AddPruneCount(pWS->m_pnPrePruneCount); 
+#endif
+}
+
+#if defined(COUNT_PRUNE_EFFECT)
+void DETECTOR::AddPruneCount(const __int64 *pCount)
+{
+    EnterThreadLock(&m_PruneLock); 
+    for (int i=0; i<m_nClassifiers; i++) 
+        m_pnPruneCount[i] += pCount[i]; 
+    LeaveThreadLock(&m_PruneLock); 
+}
+#endif
+
+// classifiers first to last-1 stage by stage over the numAlive windows of pIdx, window a 
+// at ((pIdx[a]*stepX) >> shift, y). the scores add up in pScore, the survivors stay at the 
+// front of pIdx in their order, returns how many 
+int DETECTOR::DenseStages(I_IMAGE *pIImg, int nScale, int y, int stepX, int shift, int *pIdx, 
+                          const float *pNorm, float *pScore, float *pValue, int numAlive, int first, int last, 
+                          __int64 *pPruneCount)
+{
+    CLASSIFIER *pC = m_ClassifierArray[nScale]; 
+    for (int k=first; k<last && numAlive > 0; k++) 
+    {
+        switch(pC[k].m_Feature.m_nType) 
+        {
+        case FEATURE::RECTFEATURE:
+            pC[k].m_Feature.m_pF.pRCF->EvalRow(pIImg, y, stepX, pIdx, pNorm, numAlive, pValue, shift); 
+            break; 
+        case FEATURE::NORMFEATURE: 
+            for (int a=0; a<numAlive; a++) 
+                pValue[a] = pNorm[pIdx[a]]; 
+            break; 
+        default:
+            throw "Unknown feature"; 
+        }
+
+        float *pTh = pC[k].GetFeatureTh(); 
+        float *pDScore = pC[k].GetDScore(); 
+        int numTh = pC[k].m_nNumTh; 
+        float minPosScoreTh = pC[k].GetMinPosScoreTh(); 
+        int numKept = 0; 
+        for (int a=0; a<numAlive; a++) 
+        {
+            int i = pIdx[a], j; 
+            for (j=0; j<numTh; j++) 
+                if (pValue[a] > pTh[j]) 
+                    break; 
+            pScore[i] += pDScore[j]; 
+            if (m_bRejAtNodes && pScore[i] < minPosScoreTh) 
+            {
+#if defined(COUNT_PRUNE_EFFECT)
+                pPruneCount[k] += 1; 
+#endif
+                continue; 
+            }
+            pIdx[numKept++] = i; 
+        }
+        numAlive = numKept; 
+    }
+
+    return numAlive; 
+}
+
+// windows firstCol to lastCol-1 of the row at y: the dense classifiers run stage by 
+// stage over all windows still alive, the survivors finish the cascade one by one in 
+// scan order, so the raw list comes out exactly as from the window by window scan. 
+// returns false once the raw list is full 
+bool DETECTOR::ScanRowDense(DETWORKSPACE *pWS, int nScale, int y, int firstCol, int lastCol, 
+                            I_IMAGE *pHalfIImg, int *pNumRawDetRect, int *pTotalWindows, int maxNumRawDetRect)
+{
+    IN_IMAGE *pIImg = pWS->m_pIImg; 
+    int winW = m_nWidth[nScale]; 
+    int winH = m_nHeight[nScale]; 
+    int stepW = m_nStepW[nScale]; 
+    pWS->ReserveDense(lastCol); 
+    int *pIdx = pWS->m_pDenseIdx; 
+    float *pNorm = pWS->m_pDenseNorm; 
+    float *pScore = pWS->m_pDenseScore; 
+    float *pValue = pWS->m_pDenseValue; 
+
+    IRECT rect; 
+    bool bGated = pWS->m_pSkinGate || pWS->m_pRegionGate; 
+    int numAlive = 0; 
+    for (int i=firstCol; i<lastCol; i++) 
+    {
+        if (bGated && !PassGates(pWS, nScale, i*stepW, y)) 
+            continue; 
+        rect.Reset(i*stepW, y, winW, winH); 
+        pNorm[i] = pIImg->ComputeNorm(&rect); 
+        pScore[i] = 0.0f; 
+        pIdx[numAlive++] = i; 
+    }
+    int numScanned = numAlive; 
+
+    int numStages = pWS->m_nScanStages; 
+    int first = 0; 
+    if (pHalfIImg) 
+    {
+        // the prefilter takes the place of the leading stages on the windows whose half sized 
+        // window fits in the subsampled image, the last few of the row that don't run them 
+        DETECTOR *pPre = m_pPrefilter; 
+        int numFit = 0; 
+        if ((y >> 1) + pPre->m_nHeight[nScale] <= pHalfIImg->GetHeight()) 
+            while (numFit < numAlive && 
+                   ((pIdx[numFit]*stepW) >> 1) + pPre->m_nWidth[nScale] <= pHalfIImg->GetWidth()) 
+                numFit ++; 
+        first = min(pPre->m_nClassifiers, numStages); 
+        int numKept = pPre->DenseStages(pHalfIImg, nScale, y >> 1, stepW, 1, pIdx, pNorm, pScore, pValue, 
+                                        numFit, 0, pPre->m_nClassifiers, pWS->m_pnPrePruneCount); 
+        int numLeft = DenseStages(pIImg, nScale, y, stepW, 0, pIdx + numFit, pNorm, pScore, pValue, 
+                                  numAlive - numFit, 0, first, pWS->m_pnPruneCount); 
+        for (int a=0; a<numLeft; a++) 
+            pIdx[numKept++] = pIdx[numFit + a]; 
+        numAlive = numKept; 
+    }
+    int numDense = max(min(m_nDenseStages, numStages), first); 
+    numAlive = DenseStages(pIImg, nScale, y, stepW, 0, pIdx, pNorm, pScore, pValue, numAlive, first, numDense, 
+                           pWS->m_pnPruneCount); 
+
+    SCORED_RECT *pRawDetRect = pWS->m_pRawDetRect; 
+    int numRawDetRect = *pNumRawDetRect; 
+    for (int a=0; a<numAlive; a++) 
+    {
+        int i = pIdx[a]; 
+        float score = pScore[i]; 
+        rect.Reset(i*stepW, y, winW, winH); 
+        int s = EvalStages(pIImg, &rect, nScale, pNorm[i], numDense, numStages, &score); 
+#if defined(COUNT_PRUNE_EFFECT)
+        pWS->m_pnPruneCount[min(s, m_nClassifiers-1)] += 1; 
+#endif
+        if (s == numStages && score > pWS->m_fScanScoreTh) 
+        {
+            pRawDetRect[numRawDetRect].m_rect.Reset((float)rect.m_ixMin, (float)rect.m_iyMin, 
+                (float)winW, (float)winH); 
+            pRawDetRect[numRawDetRect++].m_score = score; 
+            if (numRawDetRect >= maxNumRawDetRect) 
+            {
+                // the survivors after this one never finish, they are not counted as scanned 
+                *pNumRawDetRect = numRawDetRect; 
+                *pTotalWindows += numScanned - (numAlive-a-1); 
+                return false; 
+            }
+        }
+    }
+    *pNumRawDetRect = numRawDetRect; 
+    *pTotalWindows += numScanned; 
+    return true; 
+}
+
+#ifndef _NO_LIBJPEG
+
+int DETECTOR::DetectObjectInJPG (const char *fileName, IN_IMAGE* pIImg, int minFaceSize)
+{
+    ASSERT(m_bValid); 
+
+    // coarsest denominator that keeps the smallest wanted face no smaller than the base window 
+    int denom = 8; 
+    while (denom > 1 && (minFaceSize < denom*m_nBaseWidth || minFaceSize < denom*m_nBaseHeight))
+        denom /= 2; 
+
+    pIImg->LoadJPG(fileName, denom); 
+
+    // skip the windows that are smaller than the minimum face in the reduced image 
+    int minScale = 0; 
+    while (minScale < MAX_NUM_SCALE-1 && m_nWidth[minScale+1]*denom <= minFaceSize)
+        minScale ++; 
+
+    DetectObject(pIImg, minScale, MAX_NUM_SCALE-1); 
+    if (denom > 1) 
+        ScaleDetResults(&m_Workspace, denom); 
+    return denom; 
+}
+
+bool DETECTOR::DetectObjectWithThumbnail (const BYTE *pData, size_t size, JPEGDECODER *pDecoder, IN_IMAGE* pIImg)
+{
+    ASSERT(m_bValid); 
+
+    // the thumbnail must be a real reduction of the same picture and hold at least one window 
+    const BYTE *pThumb; 
+    size_t thumbSize; 
+    int width, height, thumbWidth, thumbHeight; 
+    bool bThumb = JPEGDECODER::FindExifThumbnail(pData, size, &pThumb, &thumbSize) && 
+                  pDecoder->GetSize(pData, size, &width, &height) && 
+                  pDecoder->GetSize(pThumb, thumbSize, &thumbWidth, &thumbHeight); 
+    if (bThumb) 
+    {
+        double aspectDiff = fabs((double)thumbWidth*height - (double)thumbHeight*width); 
+        bThumb = thumbWidth >= m_nWidth[0] && thumbHeight >= m_nHeight[0] && 
+                 width >= 2*thumbWidth && height >= 2*thumbHeight && 
+                 aspectDiff <= THUMBNAIL_ASPECT_TOLERANCE*thumbWidth*height; 
+    }
+    if (bThumb) 
+    {
+        try 
+        {
+            m_ThumbIImg.SetCompactNorm(true); 
+            pDecoder->Decode(pThumb, thumbSize, &m_ThumbIImg); 
+        }
+        catch (const char *) 
+        {
+            bThumb = false;     // a broken thumbnail doesn't make the main image unusable 
+        }
+    }
+    if (!bThumb) 
+    {
+        pDecoder->Decode(pData, size, pIImg); 
+        DetectObject(pIImg); 
+        return false; 
+    }
+
+    // coarse pass over the thumbnail, keep its raw detections in full resolution coordinates. 
+    // the merged list isn't needed until the end, it holds them in the meantime. the masks the 
+    // caller set are for the full resolution image, they wait for the fine pass 
+    DETWORKSPACE *pWS = &m_Workspace; 
+    bool bSkinMask = pWS->m_bSkinMask, bRegionMask = pWS->m_bRegionMask; 
+    pWS->ClearMasks(); 
+    pWS->m_pIImg = &m_ThumbIImg; 
+    ScanWindows(pWS, 0, MAX_NUM_SCALE-1, m_nMaxNumRawDetRect); 
+    int numThumbRect = pWS->m_nNumRawDetRect; 
+    SCORED_RECT *pThumbRect = pWS->m_pMergedDetRect; 
+    float fx = (float)width/thumbWidth; 
+    float fy = (float)height/thumbHeight; 
+    for (int i=0; i<numThumbRect; i++) 
+    {
+        const IRECT &rc = pWS->m_pRawDetRect[i].m_rect; 
+        pThumbRect[i].m_score = pWS->m_pRawDetRect[i].m_score; 
+        pThumbRect[i].m_rect.Reset(rc.m_ixMin*fx, rc.m_iyMin*fy, 
+                                   (rc.m_ixMax-rc.m_ixMin)*fx, (rc.m_iyMax-rc.m_iyMin)*fy); 
+    }
+
+    // fine pass, only the windows smaller than the thumbnail's smallest one 
+    int maxScale = 0; 
+    while (maxScale < MAX_NUM_SCALE-1 && 
+           m_nWidth[maxScale+1] < m_nWidth[0]*fx && m_nHeight[maxScale+1] < m_nHeight[0]*fy)
+        maxScale ++; 
+
+    pDecoder->Decode(pData, size, pIImg); 
+    pWS->m_bSkinMask = bSkinMask; 
+    pWS->m_bRegionMask = bRegionMask; 
+    pWS->m_pIImg = pIImg; 
+    // leave room for the thumbnail results 
+    ScanWindows(pWS, 0, maxScale, max(m_nMaxNumRawDetRect-numThumbRect, 1)); 
+
+    for (int i=0; i<numThumbRect && pWS->m_nNumRawDetRect < m_nMaxNumRawDetRect; i++) 
+        pWS->m_pRawDetRect[pWS->m_nNumRawDetRect++] = pThumbRect[i]; 
+
+    MergeRawDetRect(pWS); 
+    return true; 
+}
+
+#endif
+
+// map both raw and merged results back to an image that is factor times larger 
+void DETECTOR::ScaleDetResults(DETWORKSPACE *pWS, int factor)
+{
+    for (int i=0; i<pWS->m_nNumRawDetRect; i++) 
+    {
+        IRECT &rc = pWS->m_pRawDetRect[i].m_rect; 
+        rc.m_ixMin *= factor; rc.m_ixMax *= factor; 
+        rc.m_iyMin *= factor; rc.m_iyMax *= factor; 
+    }
+    for (int i=0; i<pWS->m_nNumMergedDetRect; i++) 
+    {
+        IRECT &rc = pWS->m_pMergedDetRect[i].m_rect; 
+        rc.m_ixMin *= factor; rc.m_ixMax *= factor; 
+        rc.m_iyMin *= factor; rc.m_iyMax *= factor; 
+    }
 }
 
 // Only differs from the function above in using ClasifyWithFeatures.
@@ -580,51 +1362,52 @@ int compare_int( const void *arg1, const void *arg2 )
             1 : ((*((const int *)arg1) < *((const int *)arg2)) ? -1 : 0); 
 }
 
-bool DETECTOR::MergeRawDetRect()
+bool DETECTOR::MergeRawDetRect(DETWORKSPACE *pWS)
 {
-    if (m_nNumRawDetRect == 0) 
+    if (pWS->m_nNumRawDetRect == 0) 
     {
-        m_nNumMergedDetRect = 0; 
+        pWS->m_nNumMergedDetRect = 0; 
         return false; 
     }
 
-	if (m_nNumRawDetRect >= MAX_NUM_MERGE_RECT) 
+	if (pWS->m_nNumRawDetRect >= MAX_NUM_MERGE_RECT) 
     {
-		m_nNumMergedDetRect = m_nNumRawDetRect; 
-		for (int i=0; i<m_nNumMergedDetRect; i++) 
-			m_pMergedDetRect[i] = m_pRawDetRect[i]; 
+		pWS->m_nNumMergedDetRect = pWS->m_nNumRawDetRect; 
+		for (int i=0; i<pWS->m_nNumMergedDetRect; i++) 
+			pWS->m_pMergedDetRect[i] = pWS->m_pRawDetRect[i]; 
 		return false;
 	}
 
-	IRECT *pSrcRc[MAX_NUM_MERGE_RECT];
-	IRECT pDstRc[MAX_NUM_MERGE_RECT];
-	int Src2Dst[MAX_NUM_MERGE_RECT];
+    if (!pWS->m_pScratch) 
+    {
+        pWS->m_pScratch = new DETWORKSPACE::MERGE_SCRATCH; 
+        if (!pWS->m_pScratch) 
+            throw "out of memory"; 
+    }
+    DETWORKSPACE::MERGE_SCRATCH *pScratch = pWS->m_pScratch; 
 
-	for(int i=0; i<m_nNumRawDetRect; i++)
-		pSrcRc[i]=&(m_pRawDetRect[i].m_rect);
+	for(int i=0; i<pWS->m_nNumRawDetRect; i++)
+		pScratch->m_pSrcRc[i]=&(pWS->m_pRawDetRect[i].m_rect);
 
-	MERGERECT mergeRect;
-	mergeRect.MergeRectangles(pSrcRc, m_nNumRawDetRect, pDstRc, &m_nNumMergedDetRect, Src2Dst, m_nNumRawDetRect);
-	for(int i=0; i<m_nNumMergedDetRect; i++) 
+	pScratch->m_Merge.MergeRectangles(pScratch->m_pSrcRc, pWS->m_nNumRawDetRect, pScratch->m_DstRc, 
+        &pWS->m_nNumMergedDetRect, pScratch->m_Src2Dst, pWS->m_nNumRawDetRect);
+	for(int i=0; i<pWS->m_nNumMergedDetRect; i++) 
     {
-		m_pMergedDetRect[i].m_rect=pDstRc[i];
-        m_pMergedDetRect[i].m_score = 1.0f; 
+		pWS->m_pMergedDetRect[i].m_rect=pScratch->m_DstRc[i];
+        pWS->m_pMergedDetRect[i].m_score = -FLT_MAX; 
+    }
+    // a merged rectangle is as confident as the best raw window of its group 
+    for(int i=0; i<pWS->m_nNumRawDetRect; i++) 
+    {
+        float &score = pWS->m_pMergedDetRect[pScratch->m_Src2Dst[i]].m_score; 
+        score = max(score, pWS->m_pRawDetRect[i].m_score); 
     }
     return true; 
 }
 
 int DETECTOR::GetDetResults(SCORED_RECT **ppRc, bool merged)
 {
-    if (merged) 
-    {
-        *ppRc = m_pMergedDetRect; 
-        return m_nNumMergedDetRect; 
-    }
-    else
-    {
-        *ppRc = m_pRawDetRect; 
-        return m_nNumRawDetRect; 
-    }
+    return m_Workspace.GetDetResults(ppRc, merged); 
 }
 
 // threshold values first, raw values later for det_i'th detection
@@ -639,5 +1422,6 @@ int DETECTOR::GetDetResults(SCORED_RECT **ppRc, bool merged)
 
 void DETECTOR::SaveNewClassifier(char *fileName)
 {
-    CLASSIFIER::WriteClassifierFile(m_ClassifierArray[0], m_nClassifiers, m_nBaseWidth, m_nBaseHeight, m_nNumFeatureTh, m_fFinalScoreTh, fileName); 
+    CLASSIFIER::WriteClassifierFile(m_ClassifierArray[0], m_nClassifiers, m_nBaseWidth, m_nBaseHeight, m_nNumFeatureTh, m_fFinalScoreTh, fileName, 
+                                    m_pfTruncScoreTh); 
 }
@@ -6,7 +6,17 @@
 #include "feature.h"
 
 #define COUNT_PRUNE_EFFECT  
+
+#if defined(COUNT_PRUNE_EFFECT)
+#include "threadpool.h"
+#endif
 #define DEFAULT_MAX_NUM_RAW_DET_RECT        1000
+#define DEFAULT_DENSE_STAGES                64      // see DETECTOR::SetDenseStages() 
+#define DEFAULT_SKIP_MARGIN                 0.375f  // see DETECTOR::SetAdaptiveStep() 
+#define ADAPTIVE_STEP_STAGES                8       // only windows rejected this early make the scan skip 
+#define DEFAULT_TILE_CACHE                  0       // see DETECTOR::SetTileCache() 
+#define TILE_BYTES_PER_PIXEL                8       // integral and compact norm data 
+#define DEFAULT_SKIN_FRACTION               0.0f    // see DETECTOR::SetSkinGate() 
 #define MAX_NUM_MERGE_RECT                  1000
 #define REQUIRED_OVERLAP                    0.4
 #define MAX_DET_GROUP	                    30
@@ -15,6 +25,19 @@
 #define MAX_NUM_SCALE                       32
 #endif
 
+// ways to derive a cascade from another one, see DETECTOR(const DETECTOR*, int). 
+// a mirror may be combined with one rotation, the mirror is applied first 
+#define CASCADE_MIRROR                      1       // left and right swapped 
+#define CASCADE_ROTATE_90                   2       // turned clockwise by 90 degrees 
+#define CASCADE_ROTATE_180                  4
+#define CASCADE_ROTATE_270                  6
+#define CASCADE_ROTATION_MASK               6
+
+// the EXIF thumbnail is used only if its aspect ratio is within this fraction of the main image's
+#define THUMBNAIL_ASPECT_TOLERANCE          0.02
+
+class JPEGDECODER; 
+
 
 // Type for Overlapping of IRECTs.
 typedef enum
@@ -58,6 +81,93 @@ public:
 						int* src2dst, int Max_merged_detection);
 };
 
+/******************************************************************************\
+*
+*   DETWORKSPACE
+*
+*       Everything a detection call writes to: the integral image, the raw and 
+*       merged result lists and the scratch space of the rectangle merge. The 
+*       buffers grow to the largest size seen and are reused after that, so a 
+*       caller that keeps one workspace per thread does no heap allocation per 
+*       image once the largest image has gone through. The DETECTOR itself is 
+*       only read, one detector can serve any number of workspaces at once. 
+*       The prune counts of COUNT_PRUNE_EFFECT are kept in the workspace too 
+*       and added to the detector's under a lock when a scan ends. 
+*
+\******************************************************************************/
+
+class DETWORKSPACE
+{
+    friend class DETECTOR; 
+    friend class MULTIDETECTOR; 
+    friend class DETCACHE; 
+    friend class DETATLAS; 
+
+    struct MERGE_SCRATCH
+    {
+        MERGERECT   m_Merge; 
+        IRECT     * m_pSrcRc[MAX_NUM_MERGE_RECT]; 
+        IRECT       m_DstRc[MAX_NUM_MERGE_RECT]; 
+        int         m_Src2Dst[MAX_NUM_MERGE_RECT]; 
+    }; 
+
+    IN_IMAGE        m_IImage; 
+    IN_IMAGE      * m_pIImg;                // image being scanned, m_IImage or the caller's 
+    int             m_nTotalWindows; 
+    int             m_nMaxNumDetRect;       // capacity of both result lists 
+    int             m_nNumRawDetRect; 
+    SCORED_RECT   * m_pRawDetRect; 
+    int             m_nNumMergedDetRect; 
+    SCORED_RECT   * m_pMergedDetRect; 
+    MERGE_SCRATCH * m_pScratch;             // allocated on the first merge, too big for the stack 
+    int             m_nMaxDenseWindows;     // capacity of the row buffers of the dense stages 
+    int           * m_pDenseIdx; 
+    float         * m_pDenseNorm; 
+    float         * m_pDenseScore; 
+    float         * m_pDenseValue; 
+    int           * m_pSkipRows;            // rows still to skip in each column, adaptive step 
+    I_IMAGE         m_HalfIImg;             // the integral image subsampled by 2, for the prefilter 
+    I_IMAGE         m_SkinIImg;             // integral of the skin mask of the image, for the skin gate 
+    bool            m_bSkinMask;            // m_SkinIImg is that of the image about to be scanned 
+    I_IMAGE         m_RegionIImg;           // integral of the region mask, windows must lie inside it 
+    bool            m_bRegionMask; 
+    I_IMAGE       * m_pSkinGate;            // the masks the scan in progress looks at, or NULL 
+    I_IMAGE       * m_pRegionGate; 
+    int             m_nNumStages;           // leading classifiers the scans evaluate, 0 for all 
+    int             m_nScanStages;          // what the scan in progress evaluates and its final threshold 
+    float           m_fScanScoreTh; 
+    int             m_nMaxPruneCount;       // capacity of both count arrays, COUNT_PRUNE_EFFECT only 
+    __int64       * m_pnPruneCount;         // windows stopped at each classifier in the scan in progress 
+    __int64       * m_pnPrePruneCount;      // the same for the prefilter 
+
+    void            Reserve(int maxNumDetRect); 
+    void            ResetPruneCount(int numClassifiers); 
+    void            ReserveDense(int numWindows); 
+
+public: 
+    DETWORKSPACE(); 
+    ~DETWORKSPACE(); 
+
+    // the workspace's own integral image (compact norm data), fill it with IN_IMAGE::Init/Load 
+    IN_IMAGE      * GetIImage() { return &m_IImage; }; 
+    // the skin mask of the color image the next scan looks at, see DETECTOR::SetSkinGate(). 
+    // it is used by that scan only. PIXFMT_GRAY8 (grayscale or IR sources) leaves no mask, 
+    // the scan then sees every window 
+    void            SetSkinMask(const BYTE *pData, int width, int height, int stride, PIXEL_FORMAT format); 
+    // the next scan only looks at windows that lie entirely on pixels set to 1 in pMask, the 
+    // others are skipped before any classifier runs. pMask is the size of the image and 0 or 1 
+    void            SetRegionMask(const IMAGE *pMask); 
+    // drop the masks set for a scan that won't happen, e.g. an image answered from a cache 
+    void            ClearMasks()    { m_bSkinMask = false; m_bRegionMask = false; }; 
+    // the scans with this workspace only evaluate the first numStages classifiers, with the final 
+    // threshold calibrated for that cut, see DETECTOR::GetTruncScoreTh(). 0 runs the whole cascade. 
+    // unlike the masks it holds until changed 
+    void            SetNumStages(int numStages) { m_nNumStages = max(numStages, 0); }; 
+    int             GetNumStages()  { return m_nNumStages; }; 
+    int             GetDetResults(SCORED_RECT **ppRc, bool merged); 
+    int             GetTotalWindows() { return m_nTotalWindows; }; 
+}; 
+
 /******************************************************************************\
 *
 *   DETECTOR
@@ -66,18 +176,26 @@ public:
 
 class DETECTOR 
 {
+    friend class MULTIDETECTOR; 
+
 public: 
     DETECTOR( const char *fileName, 
               float stepSize = 0.1f, 
               float stepScale = 1.25f,
               int maxNumRawDetRect = DEFAULT_MAX_NUM_RAW_DET_RECT, 
 			  bool  record_Features = false); 
+    // a detector for the transformed pattern: the mirrored cascade finds on an image what 
+    // pSrc finds on the flipped image, the CASCADE_ROTATE_90 one finds the faces turned 
+    // clockwise, without touching the image or retraining. transforms add up when pSrc is 
+    // itself derived. a rotation by 90 or 270 degrees swaps the window width and height. 
+    // the settings of pSrc at this point are copied 
+    DETECTOR( const DETECTOR *pSrc, int transform ); 
 
     ~DETECTOR();
     void Release(); 
 
 private: 
-    IN_IMAGE    *m_IImg;                // ptr to integral image
+    DETWORKSPACE m_Workspace;           // used by the calls that don't take a workspace 
 
     int          m_nClassifiers;        // number of classifiers
     int          m_nWidth[MAX_NUM_SCALE]; 
@@ -97,32 +215,132 @@ private:
 
 	bool         m_record_Features;		// store_Features in detection for future Regression.
 
-	int			 m_nTotalWindows;          // total number of scanned detection windows per image.
-    int          m_nNumRawDetRect; 
-    SCORED_RECT *m_pRawDetRect; 
-    int          m_nNumMergedDetRect; 
-    SCORED_RECT *m_pMergedDetRect; 
-
 	float**      m_raw;					// raw and thresh filter returns.
 	float**      m_thresh;
 
-    bool Classify (IRECT *rc, int nScale, float *score); 
+    int          m_nTransform;          // CASCADE_xxx applied to the model file's cascade, 0 for none 
+
+    int          m_nDenseStages;        // leading classifiers run over whole rows of windows 
+    int          m_nMaxSkip;            // adaptive step: most windows skipped after a rejection, 0 for off 
+    float        m_fSkipMargin;         // score shortfall per skipped window 
+    bool         m_bSkipRows;           // skip down the column as well 
+    int          m_nTileCache;          // bytes of integral data a strip of windows should fit in, 0 for none 
+    int          m_nTileCols[MAX_NUM_SCALE];    // windows across one strip, 0 for the whole width 
+    DETECTOR   * m_pPrefilter;          // cascade run on the half resolution integral first, or NULL 
+    float        m_fSkinFraction;       // skin gate: least fraction of skin pixels in a window, 0 for off 
+    unsigned int m_nMinSkin[MAX_NUM_SCALE];     // the same in pixels of the window at each scale 
+    float      * m_pfTruncScoreTh;      // final threshold of the cascade cut after n classifiers, -FLT_MAX for none 
+    int          m_nLookupStages;       // leading classifiers asked to share integral lookups 
+    SHAREDLOOKUP m_SharedLookup[MAX_NUM_SCALE]; 
+
+    bool Classify (DETWORKSPACE *pWS, IRECT *rc, int nScale, float *score, int *pSkip = NULL, 
+                   I_IMAGE *pHalfIImg = NULL); 
+    int  SkipSteps (int stage, float shortfall); 
+    int  EvalStages (I_IMAGE *pIImg, IRECT *rc, int nScale, float norm, int first, int last, float *pScore); 
     //bool ClassifyWithFeatures (IRECT *rc, int nScale, float *score, 
 				//			   float* raw, float* thresh); 
-    void SetPruneMinPosThreshold (IRECT *rc, int nScale); 
-    bool MergeRawDetRect(); 
+    void SetPruneMinPosThreshold (IN_IMAGE *pIImg, IRECT *rc, int nScale); 
+    // the scan stops once maxNumRawDetRect raw detections are found 
+    void ScanWindows(DETWORKSPACE *pWS, int minScale, int maxScale, int maxNumRawDetRect); 
+    bool ScanRowDense(DETWORKSPACE *pWS, int nScale, int y, int firstCol, int lastCol, 
+                      I_IMAGE *pHalfIImg, int *pNumRawDetRect, int *pTotalWindows, int maxNumRawDetRect); 
+    // pixels set in the mask under the window at (x,y) 
+    inline unsigned int MaskCount(const I_IMAGE *pMaskIImg, int nScale, int x, int y) 
+    {
+        int iWidth = pMaskIImg->GetIWidth(); 
+        const unsigned int *p0 = pMaskIImg->GetDataPtr() + y*iWidth + x; 
+        const unsigned int *p1 = p0 + m_nHeight[nScale]*iWidth; 
+        int w = m_nWidth[nScale]; 
+        return (p1[w] - p1[0]) - (p0[w] - p0[0]); 
+    }
+    // true if the window at (x,y) lies inside the region and has enough skin pixels 
+    inline bool PassGates(DETWORKSPACE *pWS, int nScale, int x, int y) 
+    {
+        if (pWS->m_pRegionGate && 
+            MaskCount(pWS->m_pRegionGate, nScale, x, y) != (unsigned int)(m_nWidth[nScale]*m_nHeight[nScale])) 
+            return false; 
+        return !pWS->m_pSkinGate || MaskCount(pWS->m_pSkinGate, nScale, x, y) >= m_nMinSkin[nScale]; 
+    }
+    int  DenseStages(I_IMAGE *pIImg, int nScale, int y, int stepX, int shift, int *pIdx, 
+                     const float *pNorm, float *pScore, float *pValue, int numAlive, int first, int last, 
+                     __int64 *pPruneCount); 
+    bool MergeRawDetRect(DETWORKSPACE *pWS); 
+    void ScaleDetResults(DETWORKSPACE *pWS, int factor); 
+
+#ifndef _NO_LIBJPEG
+    IN_IMAGE     m_ThumbIImg;           // integral image of the EXIF thumbnail, reused 
+#endif
 
 	bool     m_bRejAtNodes;
 
 #if defined(COUNT_PRUNE_EFFECT)
     __int64 *m_pnPruneCount; 
+    THREADLOCK   m_PruneLock; 
+    // add the counts of a finished scan 
+    void AddPruneCount(const __int64 *pCount); 
 #endif 
 
 public:
     float GetFinalScoreTh()		{ return m_fFinalScoreTh; }; 
     void  SetFinalScoreTh(float th) { m_fFinalScoreTh = th; }; 
     int   GetNumClassifiers()	{ return m_nClassifiers; }; 
-	int   GetTotalWindows()		{ return m_nTotalWindows; };
+    int   GetMaxNumRawDetRect() { return m_nMaxNumRawDetRect; }; 
+    int   GetWindowWidth(int nScale)  { return m_nWidth[nScale]; }; 
+    int   GetWindowHeight(int nScale) { return m_nHeight[nScale]; }; 
+    int   GetTransform()        { return m_nTransform; }; 
+    // orientation of the faces this detector finds, clockwise in degrees 
+    int   GetRotation()         { return (m_nTransform & CASCADE_ROTATION_MASK) * 45; }; 
+
+    // read every distinct integral corner of the first numStages classifiers once per window, 
+    // for the window by window scan only. 0 turns it off 
+    void  SetSharedLookupStages(int numStages); 
+    int   GetSharedLookupStages() { return m_SharedLookup[0].m_nFeatures; }; 
+    // integral image reads of one classifier at the base scale, with or without the sharing 
+    int   GetLookups(int stage, bool bShared); 
+
+    // run the first numStages classifiers over each row of windows at once, the survivors go 
+    // on one by one. the shared lookups only serve the stages after these, 0 turns it off 
+    void  SetDenseStages(int numStages) { m_nDenseStages = max(numStages, 0); }; 
+    int   GetDenseStages()      { return m_nDenseStages; }; 
+
+    // skip up to maxSkip windows to the right (and below with bSkipRows) of one missing an early 
+    // stage by n*margin, n windows per miss. trades recall for speed, maxSkip 0 turns it off 
+    void  SetAdaptiveStep(int maxSkip, float margin = DEFAULT_SKIP_MARGIN, bool bSkipRows = false); 
+    int   GetMaxSkip()          { return m_nMaxSkip; }; 
+
+    // scan each scale in vertical strips whose integral rows under a row of windows fit in 
+    // cacheBytes, the results are those of the raster scan. 0 scans the whole width 
+    void  SetTileCache(int cacheBytes); 
+    int   GetTileCache()        { return m_nTileCache; }; 
+
+    // a half-window cascade (FaceDetTrain -prefilter) run on the half resolution image in place of 
+    // the first stages, an approximation. NULL removes it 
+    void  SetPrefilter(const char *fileName); 
+    DETECTOR *GetPrefilter()    { return m_pPrefilter; }; 
+
+    // scan only windows with at least minFraction skin colored pixels, given the skin mask 
+    // below. trades recall for speed, 0 turns it off 
+    void  SetSkinGate(float minFraction); 
+    float GetSkinGate()         { return m_fSkinFraction; }; 
+    // the skin mask for the next DetectObject(IN_IMAGE*) 
+    void  SetSkinMask(const BYTE *pData, int width, int height, int stride, PIXEL_FORMAT format) 
+                                { m_Workspace.SetSkinMask(pData, width, height, stride, format); }; 
+
+    // runtime truncation of the cascade: a scan with DETWORKSPACE::SetNumStages(n) stops after the 
+    // first n classifiers and keeps the windows scoring above the threshold calibrated for that cut, 
+    // a cheap "probably a face" in place of the full precision. the thresholds come with the model 
+    // file, after its final threshold, FaceDetTestROC -calibrate picks them on a labeled set for the 
+    // detection rate of the whole cascade and SaveNewClassifier() writes them. a cut without one 
+    // uses the final threshold 
+    float GetTruncScoreTh(int numStages); 
+    void  SetTruncScoreTh(int numStages, float th); 
+    // the most classifiers whose integral reads at the base scale add up to no more than lookups, 
+    // among the calibrated cuts if there are any. at least 1 
+    int   StagesWithinBudget(int lookups); 
+    // the number of classifiers for the next DetectObject(IN_IMAGE*) 
+    void  SetNumStages(int numStages) { m_Workspace.SetNumStages(numStages); }; 
+    int   GetNumStages()        { return m_Workspace.GetNumStages(); }; 
+	int   GetTotalWindows()		{ return m_Workspace.GetTotalWindows(); };
 
 	void     SetReject(bool rej) { m_bRejAtNodes = rej; };
 
@@ -132,6 +350,27 @@ public:
 
     // the return value is the number of rectangles detected, up to MAX_NUM_DET_RECT
     void DetectObject (IN_IMAGE* pIImg, int minScale=0, int maxScale=MAX_NUM_SCALE-1);
+    // scan the workspace's integral image, the results are read back with pWS->GetDetResults() 
+    void DetectObject (DETWORKSPACE* pWS, int minScale=0, int maxScale=MAX_NUM_SCALE-1);
+    // the two halves of the call above, for callers that run them on different threads. 
+    // maxNumRawDetRect overrides the detector's limit on the raw list for this scan, 0 keeps it 
+    void ScanObject (DETWORKSPACE* pWS, int minScale=0, int maxScale=MAX_NUM_SCALE-1, int maxNumRawDetRect=0);
+    void MergeDetResults (DETWORKSPACE* pWS) { MergeRawDetRect(pWS); };
+#ifndef _NO_LIBJPEG
+    // decode a JPEG at the coarsest DCT scale (1, 1/2, 1/4 or 1/8) that still keeps a face of 
+    // minFaceSize pixels at or above the base window, then detect faces of at least that size. 
+    // pIImg receives the reduced integral image, the results are in original image coordinates. 
+    // returns the scale denominator used 
+    int  DetectObjectInJPG (const char *fileName, IN_IMAGE* pIImg, int minFaceSize);
+
+    // coarse-to-fine detection on an in-memory JPEG. The EXIF thumbnail is scanned first and 
+    // the faces found there are kept as they are; the full resolution image, decoded into 
+    // pIImg, is then only scanned with the windows too small to show up in the thumbnail. 
+    // Without a usable thumbnail (missing, corrupt, different aspect ratio) the whole image is 
+    // scanned as usual. Results are in full resolution coordinates. 
+    // returns true if the thumbnail was used 
+    bool DetectObjectWithThumbnail (const BYTE *pData, size_t size, JPEGDECODER *pDecoder, IN_IMAGE* pIImg);
+#endif
 	// Additionally allocate memory to store the computed feature values for all detected faces.	
 	//void DetectObjectWithFeatures (I_IMAGE* pIImg, int minScale=0, int maxScale=MAX_NUM_SCALE-1);
     int	 GetDetResults(SCORED_RECT **ppRc, bool merged);
@@ -0,0 +1,534 @@
+/******************************************************************************\
+*
+*   Member functions for the DETPIPELINE class
+*
+\******************************************************************************/
+
+#include "stdafx.h"
+#include "detpipeline.h"
+#include "threadpool.h"
+
+bool FILELISTSOURCE::Next(DETITEM *pItem)
+{
+    if (m_nNext >= m_nNumFiles)
+        return false;
+    pItem->m_szFileName = m_pszFileNames[m_nNext++];
+    return true;
+}
+
+/******************************************************************************\
+*
+*   DETPIPELINE::JOBQUEUE
+*
+\******************************************************************************/
+
+DETPIPELINE::JOBQUEUE::JOBQUEUE() :
+    m_ppJobs(NULL),
+    m_nCapacity(0),
+    m_nHead(0),
+    m_nCount(0),
+    m_bClosed(false)
+{
+    InitThreadLock(&m_Lock);
+#if defined(_WIN32)
+    m_hSlotSem = NULL;
+    m_hJobSem = NULL;
+#else
+    pthread_cond_init(&m_NotFull, NULL);
+    pthread_cond_init(&m_NotEmpty, NULL);
+#endif
+}
+
+DETPIPELINE::JOBQUEUE::~JOBQUEUE()
+{
+#if defined(_WIN32)
+    if (m_hSlotSem) CloseHandle(m_hSlotSem);
+    if (m_hJobSem) CloseHandle(m_hJobSem);
+#else
+    pthread_cond_destroy(&m_NotFull);
+    pthread_cond_destroy(&m_NotEmpty);
+#endif
+    DeleteThreadLock(&m_Lock);
+    if (m_ppJobs) delete []m_ppJobs;
+}
+
+// empty and open the queue, only while no thread uses it
+void DETPIPELINE::JOBQUEUE::Init(int capacity)
+{
+    if (m_nCapacity != capacity)
+    {
+        if (m_ppJobs) delete []m_ppJobs;
+        m_ppJobs = new JOB * [capacity];
+        m_nCapacity = capacity;
+    }
+    m_nHead = 0;
+    m_nCount = 0;
+    m_bClosed = false;
+
+#if defined(_WIN32)
+    if (m_hSlotSem) CloseHandle(m_hSlotSem);
+    if (m_hJobSem) CloseHandle(m_hJobSem);
+    m_hSlotSem = CreateSemaphore(NULL, capacity, capacity, NULL);
+    m_hJobSem = CreateSemaphore(NULL, 0, MAXLONG, NULL);
+    if (m_hSlotSem == NULL || m_hJobSem == NULL)
+        throw "Job queue creation failed";
+#endif
+}
+
+void DETPIPELINE::JOBQUEUE::Push(JOB *pJob)
+{
+#if defined(_WIN32)
+    WaitForSingleObject(m_hSlotSem, INFINITE);
+    EnterThreadLock(&m_Lock);
+    m_ppJobs[(m_nHead + m_nCount++) % m_nCapacity] = pJob;
+    LeaveThreadLock(&m_Lock);
+    ReleaseSemaphore(m_hJobSem, 1, NULL);
+#else
+    EnterThreadLock(&m_Lock);
+    while (m_nCount == m_nCapacity)
+        pthread_cond_wait(&m_NotFull, &m_Lock);
+    m_ppJobs[(m_nHead + m_nCount++) % m_nCapacity] = pJob;
+    pthread_cond_signal(&m_NotEmpty);
+    LeaveThreadLock(&m_Lock);
+#endif
+}
+
+DETPIPELINE::JOB * DETPIPELINE::JOBQUEUE::Pop()
+{
+#if defined(_WIN32)
+    WaitForSingleObject(m_hJobSem, INFINITE);
+    EnterThreadLock(&m_Lock);
+    if (m_nCount == 0)
+    {
+        // closed, pass the wake-up on to the next waiting thread
+        LeaveThreadLock(&m_Lock);
+        ReleaseSemaphore(m_hJobSem, 1, NULL);
+        return NULL;
+    }
+    JOB *pJob = m_ppJobs[m_nHead];
+    m_nHead = (m_nHead + 1) % m_nCapacity;
+    m_nCount --;
+    LeaveThreadLock(&m_Lock);
+    ReleaseSemaphore(m_hSlotSem, 1, NULL);
+#else
+    EnterThreadLock(&m_Lock);
+    while (m_nCount == 0 && !m_bClosed)
+        pthread_cond_wait(&m_NotEmpty, &m_Lock);
+    if (m_nCount == 0)
+    {
+        LeaveThreadLock(&m_Lock);
+        return NULL;
+    }
+    JOB *pJob = m_ppJobs[m_nHead];
+    m_nHead = (m_nHead + 1) % m_nCapacity;
+    m_nCount --;
+    pthread_cond_signal(&m_NotFull);
+    LeaveThreadLock(&m_Lock);
+#endif
+    return pJob;
+}
+
+// the jobs still queued are handed out, after that Pop() returns NULL
+void DETPIPELINE::JOBQUEUE::Close()
+{
+    EnterThreadLock(&m_Lock);
+    m_bClosed = true;
+#if defined(_WIN32)
+    LeaveThreadLock(&m_Lock);
+    ReleaseSemaphore(m_hJobSem, 1, NULL);
+#else
+    pthread_cond_broadcast(&m_NotEmpty);
+    LeaveThreadLock(&m_Lock);
+#endif
+}
+
+/******************************************************************************\
+*
+*   DETPIPELINE
+*
+\******************************************************************************/
+
+DETPIPELINE::DETPIPELINE(DETECTOR *pDetector, int maxInFlight) :
+    m_pDetector(pDetector),
+    m_pCache(NULL),
+    m_nMinScale(0),
+    m_nMaxScale(MAX_NUM_SCALE-1),
+    m_bInOrder(true),
+    m_nMaxInFlight(maxInFlight),
+    m_nNumJobs(0),
+    m_pJobs(NULL),
+    m_pSource(NULL),
+    m_bSourceDone(false),
+    m_nNextIndex(0),
+    m_bStop(false),
+    m_pCallback(NULL),
+    m_pContext(NULL),
+    m_ppPending(NULL),
+    m_nNextDeliver(0),
+    m_nNumDelivered(0)
+{
+    if (m_pDetector == NULL || !m_pDetector->IsValid())
+        throw "Invalid detector";
+
+    for (int i=0; i<PIPE_NUM_STAGES; i++)
+    {
+        m_nQueueSize[i] = 0;
+        m_nRunning[i] = 0;
+        SetNumThreads(i, 0);
+    }
+    InitThreadLock(&m_Lock);
+    InitThreadLock(&m_DeliverLock);
+}
+
+DETPIPELINE::~DETPIPELINE()
+{
+    if (m_pJobs) delete []m_pJobs;
+    if (m_ppPending) delete []m_ppPending;
+    DeleteThreadLock(&m_Lock);
+    DeleteThreadLock(&m_DeliverLock);
+}
+
+void DETPIPELINE::SetNumThreads(int stage, int numThreads)
+{
+    if (stage < 0 || stage >= PIPE_NUM_STAGES)
+        throw "Invalid pipeline stage";
+    if (numThreads <= 0)
+        numThreads = (stage == PIPE_SCAN) ? THREADPOOL::GetNumProcessors() : 1;
+    m_nNumThreads[stage] = numThreads;
+}
+
+void DETPIPELINE::SetQueueSize(int stage, int queueSize)
+{
+    if (stage < 0 || stage >= PIPE_NUM_STAGES)
+        throw "Invalid pipeline stage";
+    m_nQueueSize[stage] = max(queueSize, 0);
+}
+
+void DETPIPELINE::SetScaleRange(int minScale, int maxScale)
+{
+    if (minScale < 0 || maxScale >= MAX_NUM_SCALE || minScale > maxScale)
+        throw "scale out of range";
+    m_nMinScale = minScale;
+    m_nMaxScale = maxScale;
+}
+
+// a free job filled with the next image of the source, NULL when there is none.
+// waits while all jobs are in the pipeline, that is what keeps the memory bounded
+DETPIPELINE::JOB * DETPIPELINE::TakeJob()
+{
+    JOB *pJob = m_Queues[PIPE_DECODE].Pop();
+    if (pJob == NULL)
+        return NULL;
+
+    EnterThreadLock(&m_Lock);
+    if (!m_bSourceDone && !m_bStop)
+    {
+        pJob->m_Item = DETITEM();
+        m_bSourceDone = !m_pSource->Next(&pJob->m_Item);
+    }
+    if (m_bSourceDone || m_bStop)
+    {
+        LeaveThreadLock(&m_Lock);
+        m_Queues[PIPE_DECODE].Push(pJob);   // never waits, the queue holds every job
+        return NULL;
+    }
+    pJob->m_nIndex = m_nNextIndex ++;
+    LeaveThreadLock(&m_Lock);
+
+    pJob->m_bFailed = false;
+    pJob->m_szError[0] = '\0';
+    pJob->m_bCached = false;
+    return pJob;
+}
+
+void DETPIPELINE::Process(WORKER *pWorker, JOB *pJob)
+{
+    if (pJob->m_bFailed)
+        return;
+
+    const DETITEM &item = pJob->m_Item;
+    try
+    {
+        switch (pWorker->m_nStage)
+        {
+        case PIPE_DECODE:
+            if (item.m_pPixels)
+                break;
+#ifndef _NO_LIBJPEG
+            if (item.m_pData)
+            {
+                pWorker->m_Decoder.Decode(item.m_pData, item.m_nSize, &pJob->m_Image);
+                break;
+            }
+            if (item.m_szFileName)
+            {
+                const char *ext = strrchr(item.m_szFileName, '.');
+                if (ext != NULL && _stricmp(ext+1, "jpg") == 0)
+                {
+                    pWorker->m_Decoder.DecodeFile(item.m_szFileName, &pJob->m_Image);
+                    break;
+                }
+            }
+#endif
+            if (item.m_szFileName == NULL)
+                throw "No image given";
+            pJob->m_Image.Load(item.m_szFileName);
+            break;
+
+        case PIPE_INTEGRAL:
+            // a mask left by an earlier item of this slot whose scan never ran must not gate this one
+            pJob->m_Workspace.ClearMasks();
+            if (item.m_pPixels)
+            {
+                pJob->m_Workspace.GetIImage()->Init(item.m_pPixels, item.m_nWidth, item.m_nHeight,
+                                                    item.m_nStride, item.m_Format);
+                if (m_pDetector->GetSkinGate() > 0.0f)
+                    pJob->m_Workspace.SetSkinMask(item.m_pPixels, item.m_nWidth, item.m_nHeight,
+                                                  item.m_nStride, item.m_Format);
+            }
+            else
+                pJob->m_Workspace.GetIImage()->Init(&pJob->m_Image);
+            pJob->m_bCached = m_pCache && m_pCache->Lookup(&pJob->m_Workspace, &pJob->m_nHash);
+            break;
+
+        case PIPE_SCAN:
+            if (!pJob->m_bCached)
+                m_pDetector->ScanObject(&pJob->m_Workspace, m_nMinScale, m_nMaxScale);
+            break;
+
+        case PIPE_MERGE:
+            if (!pJob->m_bCached)
+            {
+                m_pDetector->MergeDetResults(&pJob->m_Workspace);
+                if (m_pCache)
+                    m_pCache->Insert(&pJob->m_Workspace, pJob->m_nHash);
+            }
+            break;
+        }
+    }
+    catch (const char *szMsg)
+    {
+        pJob->m_bFailed = true;
+        strncpy(pJob->m_szError, szMsg, sizeof(pJob->m_szError)-1);
+        pJob->m_szError[sizeof(pJob->m_szError)-1] = '\0';
+    }
+    catch (...)
+    {
+        pJob->m_bFailed = true;
+        strcpy(pJob->m_szError, "Out of memory");
+    }
+}
+
+// called with m_DeliverLock held
+void DETPIPELINE::Report(JOB *pJob)
+{
+    if (m_bStop)
+        return;
+
+    DETRESULT result;
+    result.m_nIndex = pJob->m_nIndex;
+    result.m_pUser = pJob->m_Item.m_pUser;
+    result.m_szError = pJob->m_bFailed ? pJob->m_szError : NULL;
+    result.m_pImage = pJob->m_Item.m_pPixels ? NULL : &pJob->m_Image;
+    result.m_nWidth = 0;
+    result.m_nHeight = 0;
+    result.m_nNumRawRect = 0;
+    result.m_pRawRect = NULL;
+    result.m_nNumMergedRect = 0;
+    result.m_pMergedRect = NULL;
+    if (!pJob->m_bFailed)
+    {
+        result.m_nWidth = pJob->m_Workspace.GetIImage()->GetWidth();
+        result.m_nHeight = pJob->m_Workspace.GetIImage()->GetHeight();
+        result.m_nNumRawRect = pJob->m_Workspace.GetDetResults(&result.m_pRawRect, false);
+        result.m_nNumMergedRect = pJob->m_Workspace.GetDetResults(&result.m_pMergedRect, true);
+    }
+
+    m_nNumDelivered ++;
+    if (!m_pCallback(&result, m_pContext))
+    {
+        EnterThreadLock(&m_Lock);
+        m_bStop = true;
+        LeaveThreadLock(&m_Lock);
+    }
+}
+
+// hand the result to the callback, in input order if asked to, and recycle the job
+void DETPIPELINE::Deliver(JOB *pJob)
+{
+    EnterThreadLock(&m_DeliverLock);
+    if (!m_bInOrder)
+    {
+        Report(pJob);
+        m_Queues[PIPE_DECODE].Push(pJob);
+    }
+    else
+    {
+        // the jobs in flight always have indices in [m_nNextDeliver, m_nNextDeliver+m_nNumJobs)
+        m_ppPending[pJob->m_nIndex % m_nNumJobs] = pJob;
+        for (;;)
+        {
+            JOB *pNext = m_ppPending[m_nNextDeliver % m_nNumJobs];
+            if (pNext == NULL || pNext->m_nIndex != m_nNextDeliver)
+                break;
+            m_ppPending[m_nNextDeliver % m_nNumJobs] = NULL;
+            m_nNextDeliver ++;
+            Report(pNext);
+            m_Queues[PIPE_DECODE].Push(pNext);
+        }
+    }
+    LeaveThreadLock(&m_DeliverLock);
+}
+
+void DETPIPELINE::StageLoop(WORKER *pWorker)
+{
+    int stage = pWorker->m_nStage;
+    for (;;)
+    {
+        JOB *pJob = (stage == PIPE_DECODE) ? TakeJob() : m_Queues[stage].Pop();
+        if (pJob == NULL)
+            break;
+        Process(pWorker, pJob);
+        if (stage == PIPE_MERGE)
+            Deliver(pJob);
+        else
+            m_Queues[stage+1].Push(pJob);
+    }
+    LeaveStage(stage);
+}
+
+// a thread of stage is done, the last one lets the next stage run dry
+void DETPIPELINE::LeaveStage(int stage)
+{
+    EnterThreadLock(&m_Lock);
+    bool bLast = (--m_nRunning[stage] == 0);
+    LeaveThreadLock(&m_Lock);
+    if (bLast && stage+1 < PIPE_NUM_STAGES)
+        m_Queues[stage+1].Close();
+}
+
+#if defined(_WIN32)
+DWORD WINAPI DETPIPELINE::StageThreadProc(LPVOID lpParam)
+{
+    WORKER *pWorker = (WORKER *)lpParam;
+    pWorker->m_pPipeline->StageLoop(pWorker);
+    return 0;
+}
+#else
+void * DETPIPELINE::StageThreadProc(void *lpParam)
+{
+    WORKER *pWorker = (WORKER *)lpParam;
+    pWorker->m_pPipeline->StageLoop(pWorker);
+    return NULL;
+}
+#endif
+
+int DETPIPELINE::Run(DETSOURCE *pSource, DETCALLBACK pCallback, void *pContext)
+{
+    if (pSource == NULL || pCallback == NULL)
+        throw "Invalid pipeline input";
+
+    // the jobs are kept from one run to the next, their buffers with them
+    int numThreads = 0;
+    for (int i=0; i<PIPE_NUM_STAGES; i++)
+        numThreads += m_nNumThreads[i];
+    int numJobs = m_nMaxInFlight > 0 ? m_nMaxInFlight : numThreads + m_nNumThreads[PIPE_SCAN];
+    if (numJobs != m_nNumJobs)
+    {
+        if (m_pJobs) delete []m_pJobs;
+        if (m_ppPending) delete []m_ppPending;
+        m_pJobs = NULL;
+        m_ppPending = NULL;
+        m_nNumJobs = 0;
+        m_pJobs = new JOB [numJobs];
+        m_ppPending = new JOB * [numJobs];
+        m_nNumJobs = numJobs;
+    }
+    for (int i=0; i<PIPE_NUM_STAGES; i++)
+    {
+        int queueSize = m_nQueueSize[i];
+        if (i == PIPE_DECODE || queueSize <= 0 || queueSize > m_nNumJobs)
+            queueSize = m_nNumJobs;
+        m_Queues[i].Init(queueSize);
+        m_nRunning[i] = m_nNumThreads[i];
+    }
+    for (int i=0; i<m_nNumJobs; i++)
+    {
+        m_ppPending[i] = NULL;
+        m_Queues[PIPE_DECODE].Push(&m_pJobs[i]);
+    }
+
+    m_pSource = pSource;
+    m_bSourceDone = false;
+    m_bStop = false;
+    m_nNextIndex = 0;
+    m_pCallback = pCallback;
+    m_pContext = pContext;
+    m_nNextDeliver = 0;
+    m_nNumDelivered = 0;
+
+    WORKER *pWorkers = new WORKER [numThreads];
+    int k = 0;
+    for (int i=0; i<PIPE_NUM_STAGES; i++)
+    {
+        for (int j=0; j<m_nNumThreads[i]; j++, k++)
+        {
+            pWorkers[k].m_pPipeline = this;
+            pWorkers[k].m_nStage = i;
+        }
+    }
+
+    // the last stages start first, so if a thread can't be created every thread already
+    // running has the stages after it running too and never waits on a full queue for good
+#if defined(_WIN32)
+    HANDLE *phThreads = new HANDLE [numThreads];
+#else
+    pthread_t *pThreads = new pthread_t [numThreads];
+#endif
+    int firstStarted = numThreads;
+    while (firstStarted > 0)
+    {
+        WORKER *pWorker = &pWorkers[firstStarted-1];
+#if defined(_WIN32)
+        DWORD dwThreadId;
+        phThreads[firstStarted-1] = CreateThread(NULL, 0, StageThreadProc, pWorker, 0, &dwThreadId);
+        if (phThreads[firstStarted-1] == NULL)
+            break;
+#else
+        if (pthread_create(&pThreads[firstStarted-1], NULL, StageThreadProc, pWorker) != 0)
+            break;
+#endif
+        firstStarted --;
+    }
+    bool bFailed = firstStarted > 0;
+    if (bFailed)
+    {
+        // stop taking images and leave the stages in place of the threads that never ran,
+        // the running ones then drain what is in flight and return
+        EnterThreadLock(&m_Lock);
+        m_bStop = true;
+        LeaveThreadLock(&m_Lock);
+        for (int i=0; i<firstStarted; i++)
+            LeaveStage(pWorkers[i].m_nStage);
+    }
+
+#if defined(_WIN32)
+    for (int i=firstStarted; i<numThreads; i++)
+    {
+        WaitForSingleObject(phThreads[i], INFINITE);
+        CloseHandle(phThreads[i]);
+    }
+    delete []phThreads;
+#else
+    for (int i=firstStarted; i<numThreads; i++)
+        pthread_join(pThreads[i], NULL);
+    delete []pThreads;
+#endif
+
+    delete []pWorkers;
+
+    m_pSource = NULL;
+    if (bFailed)
+        throw "Thread creation failed";
+    return m_nNumDelivered;
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+/******************************************************************************\
+*
+*   DETPIPELINE
+*
+*       Batch face detection as a pipeline. Each image goes through four
+*       stages, each with its own threads:
+*
+*           PIPE_DECODE     read the file and decode it to a gray image
+*           PIPE_INTEGRAL   build the integral images
+*           PIPE_SCAN       run the cascade over all windows
+*           PIPE_MERGE      merge the raw detections and report the result
+*
+*       so the decoding of one image overlaps with the scanning of others.
+*       The stages are connected by bounded queues, and an image only enters
+*       the pipeline when one of the maxInFlight job slots is free. A slot
+*       holds the gray image, the integral images and the result lists and is
+*       reused for the next image, so memory stays bounded no matter how fast
+*       the source is, and there is no heap allocation per image once the
+*       slots have grown to the largest image.
+*
+*       Images are pulled from a DETSOURCE, results come back through a
+*       callback, either in submission order or as soon as each image is
+*       done. The callback is never called on two threads at once.
+*
+*       Typical use:
+*
+*           DETPIPELINE pipeline(&detector);
+*           pipeline.SetNumThreads(PIPE_SCAN, 4);
+*           FILELISTSOURCE source(pszFileNames, numFiles);
+*           pipeline.Run(&source, OnResult, &context);
+*
+*       The detector is only read while the pipeline runs, don't change its
+*       settings from the callback.
+*
+\******************************************************************************/
+
+#include "detector.h"
+#include "detcache.h"
+#include "jpegdec.h"
+#include "threadpool.h"
+
+// pipeline stages
+#define PIPE_DECODE             0
+#define PIPE_INTEGRAL           1
+#define PIPE_SCAN               2
+#define PIPE_MERGE              3
+#define PIPE_NUM_STAGES         4
+
+// one image handed to the pipeline, exactly one of the three inputs is set
+struct DETITEM
+{
+    const char    * m_szFileName;       // image file, JPEG files are decoded from memory
+    const BYTE    * m_pData;            // or a JPEG image in memory
+    size_t          m_nSize;
+    const BYTE    * m_pPixels;          // or raw pixels, they skip the decode stage
+    int             m_nWidth;
+    int             m_nHeight;
+    int             m_nStride;
+    PIXEL_FORMAT    m_Format;
+    void          * m_pUser;            // handed back with the result
+
+    DETITEM() : m_szFileName(NULL), m_pData(NULL), m_nSize(0), m_pPixels(NULL),
+                m_nWidth(0), m_nHeight(0), m_nStride(0), m_Format(PIXFMT_GRAY8), m_pUser(NULL) {};
+};
+
+// where the images come from. Next() is called by the decode threads, one call at
+// a time, and must keep the buffers of an item valid until its result is reported
+class DETSOURCE
+{
+public:
+    virtual ~DETSOURCE() {};
+    // fill in the next image, false at the end of the input
+    virtual bool    Next(DETITEM *pItem) = 0;
+};
+
+// the images of a file list, in list order
+class FILELISTSOURCE : public DETSOURCE
+{
+    const char * const * m_pszFileNames;
+    int             m_nNumFiles;
+    int             m_nNext;
+
+public:
+    FILELISTSOURCE(const char * const *pszFileNames, int numFiles) :
+        m_pszFileNames(pszFileNames), m_nNumFiles(numFiles), m_nNext(0) {};
+
+    virtual bool    Next(DETITEM *pItem);
+};
+
+// what the callback gets for each image, only valid during the callback
+struct DETRESULT
+{
+    int             m_nIndex;           // position in the input, from 0
+    void          * m_pUser;            // DETITEM::m_pUser
+    const char    * m_szError;          // NULL, or why the image could not be processed
+    IMAGE         * m_pImage;           // the decoded gray image, may be drawn on. NULL for raw pixels
+    int             m_nWidth;
+    int             m_nHeight;
+    int             m_nNumRawRect;
+    SCORED_RECT   * m_pRawRect;
+    int             m_nNumMergedRect;
+    SCORED_RECT   * m_pMergedRect;
+};
+
+// return false to stop: no more images are taken from the source, the ones already
+// in the pipeline are finished but not reported
+typedef bool (*DETCALLBACK)(const DETRESULT *pResult, void *pContext);
+
+class DETPIPELINE
+{
+    // everything one image needs on its way through the pipeline
+    struct JOB
+    {
+        int             m_nIndex;
+        DETITEM         m_Item;
+        bool            m_bFailed;
+        char            m_szError[256];
+        IMAGE           m_Image;
+        DETWORKSPACE    m_Workspace;
+        unsigned __int64 m_nHash;           // DETCACHE key of the image
+        bool            m_bCached;          // the results came from the cache, nothing to scan
+    };
+
+    // bounded blocking FIFO of jobs
+    class JOBQUEUE
+    {
+        JOB          ** m_ppJobs;
+        int             m_nCapacity;
+        int             m_nHead;
+        int             m_nCount;
+        bool            m_bClosed;
+        THREADLOCK      m_Lock;
+#if defined(_WIN32)
+        HANDLE          m_hSlotSem;     // counts the free places
+        HANDLE          m_hJobSem;      // counts the queued jobs, plus one wake-up once closed
+#else
+        pthread_cond_t  m_NotFull;
+        pthread_cond_t  m_NotEmpty;
+#endif
+
+    public:
+        JOBQUEUE();
+        ~JOBQUEUE();
+        void            Init(int capacity);
+        void            Push(JOB *pJob);    // waits while the queue is full
+        JOB           * Pop();              // waits while it is empty, NULL once closed and empty
+        void            Close();
+    };
+
+    // state owned by one pipeline thread
+    struct WORKER
+    {
+        DETPIPELINE   * m_pPipeline;
+        int             m_nStage;
+#ifndef _NO_LIBJPEG
+        JPEGDECODER     m_Decoder;
+#endif
+    };
+
+    DETECTOR      * m_pDetector;
+    DETCACHE      * m_pCache;
+    int             m_nMinScale;
+    int             m_nMaxScale;
+    bool            m_bInOrder;
+
+    int             m_nMaxInFlight;
+    int             m_nNumJobs;
+    JOB           * m_pJobs;
+    JOBQUEUE        m_Queues[PIPE_NUM_STAGES];  // input of each stage, the decode stage's are the free jobs
+    int             m_nQueueSize[PIPE_NUM_STAGES];
+    int             m_nNumThreads[PIPE_NUM_STAGES];
+
+    // protected by m_Lock
+    THREADLOCK      m_Lock;
+    DETSOURCE     * m_pSource;
+    bool            m_bSourceDone;
+    int             m_nNextIndex;
+    int             m_nRunning[PIPE_NUM_STAGES];    // threads of each stage still working
+    bool            m_bStop;
+
+    // protected by m_DeliverLock
+    THREADLOCK      m_DeliverLock;
+    DETCALLBACK     m_pCallback;
+    void          * m_pContext;
+    JOB          ** m_ppPending;                // finished jobs waiting for their turn, by index
+    int             m_nNextDeliver;
+    int             m_nNumDelivered;
+
+    JOB           * TakeJob();
+    void            Process(WORKER *pWorker, JOB *pJob);
+    void            Deliver(JOB *pJob);
+    void            Report(JOB *pJob);
+    void            StageLoop(WORKER *pWorker);
+    void            LeaveStage(int stage);
+
+#if defined(_WIN32)
+    static DWORD WINAPI StageThreadProc(LPVOID lpParam);
+#else
+    static void *   StageThreadProc(void *lpParam);
+#endif
+
+public:
+    // maxInFlight 0 allows two images per scan thread plus one per other thread
+    DETPIPELINE(DETECTOR *pDetector, int maxInFlight = 0);
+    ~DETPIPELINE();
+
+    // numThreads 0 restores the default: one scan thread per processor, one for each other stage
+    void            SetNumThreads(int stage, int numThreads);
+    // capacity of the queue in front of a stage, 0 lets it hold every job
+    void            SetQueueSize(int stage, int queueSize);
+    // bInOrder false reports every image as soon as it is done
+    void            SetResultOrder(bool bInOrder) { m_bInOrder = bInOrder; };
+    void            SetScaleRange(int minScale, int maxScale);
+    // look each image up in pCache after its integral image is built, a near duplicate
+    // of an image seen before is reported with the cached merged results and no raw ones,
+    // without a scan. the others are scanned and added. images in flight at the same time
+    // don't see each other's results. NULL, the default, turns it off
+    void            SetResultCache(DETCACHE *pCache) { m_pCache = pCache; };
+
+    // run every image of pSource through the detector, returns when all are reported.
+    // the return value is the number of results reported
+    int             Run(DETSOURCE *pSource, DETCALLBACK pCallback, void *pContext);
+};
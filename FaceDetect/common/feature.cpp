@@ -124,6 +124,19 @@ void RCFEATURE::Init(const RCFEATURE *src, const float scale)
     }
 }
 
+void RCFEATURE::InitHalf(const RCFEATURE *src)
+{
+    Init(src, 0.5f); 
+    for (int i = 0; i < m_nRects; i++)
+    {
+        IRECT &iRect = m_wRectArray[i].m_rect;
+        if (iRect.m_ixMax <= iRect.m_ixMin || iRect.m_iyMax <= iRect.m_iyMin) 
+            throw "rectangle too small for half resolution"; 
+        // Init() has kept the weight per pixel, each subsampled pixel holds four 
+        m_wRectArray[i].m_weight *= 0.25f; 
+    }
+}
+
 void RCFEATURE::InitSS(const RCFEATURE *src, const float scale)
 {
     ASSERT(src != NULL);
@@ -159,6 +172,46 @@ void RCFEATURE::InitSS(const RCFEATURE *src, const float scale)
     }
 }
 
+// the transformed feature gives, on a window, exactly the value src gives on the 
+// window transformed back: every rectangle covers the same pixels, turned. the 
+// weights are copied as they are 
+void RCFEATURE::InitTransform(const RCFEATURE *src, int width, int height, bool bMirror, int rotation)
+{
+    ASSERT(src != NULL);
+    Release(); 
+
+    m_nRects = src->m_nRects;
+    m_wRectArray = new WEIGHTED_RECT[m_nRects];
+    if (m_wRectArray == NULL)
+    {
+        m_nRects = 0; 
+        return;
+    }
+
+    for (int i = 0; i < m_nRects; i++)
+    {
+        WEIGHTED_RECT &wRect = m_wRectArray[i];
+        wRect = src->m_wRectArray[i];
+        IRECT &iRect = wRect.m_rect;
+        int w = width, h = height; 
+        if (bMirror)
+        {
+            int xMin = w - iRect.m_ixMax;
+            iRect.m_ixMax = w - iRect.m_ixMin;
+            iRect.m_ixMin = xMin;
+        }
+        // a quarter turn clockwise takes (x, y) to (h-y, x) 
+        for (int r = 0; r < (rotation & 3); r++)
+        {
+            IRECT rc = iRect; 
+            iRect.m_ixMin = h - rc.m_iyMax;
+            iRect.m_ixMax = h - rc.m_iyMin;
+            iRect.m_iyMin = rc.m_ixMin;
+            iRect.m_iyMax = rc.m_ixMax;
+            int t = w; w = h; h = t; 
+        }
+    }
+}
 
 void RCFEATURE::Write(FILE *file)
 {
@@ -665,6 +718,58 @@ float RCFEATURE::Eval(I_IMAGE *pIImg, float norm, int x, int y)
     return value*norm;
 }
 
+// the windows of a row read their corners from the same integral rows, so a stage 
+// evaluated over the whole row streams through a few cache lines. with SSE2 four 
+// windows are summed at a time; a group whose rectangle sum doesn't fit 31 bits 
+// (only possible on huge images) is done one by one so the float conversion 
+// stays the same as in Eval() 
+void RCFEATURE::EvalRow(I_IMAGE *pIImg, int y, int stepX, const int *pIdx, const float *pNorm, int count, float *pValue, 
+                        int shift)
+{
+    const unsigned int *pRow = pIImg->GetDataPtr() + y*pIImg->GetIWidth(); 
+    int nIWidth = pIImg->GetIWidth(); 
+    int a = 0; 
+
+#if defined(USE_SSE2)
+    for (; a+4 <= count; a+=4) 
+    {
+        const unsigned int *p0 = pRow + ((pIdx[a]*stepX) >> shift); 
+        const unsigned int *p1 = pRow + ((pIdx[a+1]*stepX) >> shift); 
+        const unsigned int *p2 = pRow + ((pIdx[a+2]*stepX) >> shift); 
+        const unsigned int *p3 = pRow + ((pIdx[a+3]*stepX) >> shift); 
+        __m128 value = _mm_setzero_ps(); 
+        int i; 
+        for (i = 0; i < m_nRects; i++) 
+        {
+            const WEIGHTED_RECT& wRect = m_wRectArray[i];
+            const int o00 = wRect.m_rect.m_iyMin*nIWidth + wRect.m_rect.m_ixMin; 
+            const int o01 = wRect.m_rect.m_iyMax*nIWidth + wRect.m_rect.m_ixMin; 
+            const int o10 = wRect.m_rect.m_iyMin*nIWidth + wRect.m_rect.m_ixMax; 
+            const int o11 = wRect.m_rect.m_iyMax*nIWidth + wRect.m_rect.m_ixMax; 
+            __m128i v00 = _mm_setr_epi32(p0[o00], p1[o00], p2[o00], p3[o00]); 
+            __m128i v01 = _mm_setr_epi32(p0[o01], p1[o01], p2[o01], p3[o01]); 
+            __m128i v10 = _mm_setr_epi32(p0[o10], p1[o10], p2[o10], p3[o10]); 
+            __m128i v11 = _mm_setr_epi32(p0[o11], p1[o11], p2[o11], p3[o11]); 
+            __m128i sub = _mm_sub_epi32(_mm_sub_epi32(v11, v01), _mm_sub_epi32(v10, v00)); 
+            if (_mm_movemask_ps(_mm_castsi128_ps(sub))) 
+                break; 
+            value = _mm_add_ps(value, _mm_mul_ps(_mm_set1_ps(wRect.m_weight), _mm_cvtepi32_ps(sub))); 
+        }
+        if (i < m_nRects) 
+        {
+            for (int k = a; k < a+4; k++) 
+                pValue[k] = Eval(pIImg, pNorm[pIdx[k]], (pIdx[k]*stepX) >> shift, y); 
+            continue; 
+        }
+        __m128 norm = _mm_setr_ps(pNorm[pIdx[a]], pNorm[pIdx[a+1]], pNorm[pIdx[a+2]], pNorm[pIdx[a+3]]); 
+        _mm_storeu_ps(pValue+a, _mm_mul_ps(value, norm)); 
+    }
+#endif
+
+    for (; a < count; a++) 
+        pValue[a] = Eval(pIImg, pNorm[pIdx[a]], (pIdx[a]*stepX) >> shift, y); 
+}
+
 FEATURE::FEATURE() : 
     m_nType(UNKNOWN)
 {
@@ -742,4 +847,131 @@ float FEATURE::Eval(I_IMAGE *pIImg, float norm, int x, int y)
         return norm; 
     }
     return 0; 
-}
\ No newline at end of file
+}
+/******************************************************************************\
+*
+*   SHAREDLOOKUP
+*
+\******************************************************************************/
+
+SHAREDLOOKUP::SHAREDLOOKUP() : 
+    m_nFeatures(0), 
+    m_pLoadStart(NULL), 
+    m_pSumStart(NULL), 
+    m_pRefStart(NULL), 
+    m_pLoads(NULL), 
+    m_pSums(NULL), 
+    m_pRefs(NULL)
+{
+}
+
+SHAREDLOOKUP::~SHAREDLOOKUP()
+{
+    Release(); 
+}
+
+void SHAREDLOOKUP::Release()
+{
+    if (m_pLoadStart) { delete []m_pLoadStart; m_pLoadStart = NULL; }
+    if (m_pSumStart) { delete []m_pSumStart; m_pSumStart = NULL; }
+    if (m_pRefStart) { delete []m_pRefStart; m_pRefStart = NULL; }
+    if (m_pLoads) { delete []m_pLoads; m_pLoads = NULL; }
+    if (m_pSums) { delete []m_pSums; m_pSums = NULL; }
+    if (m_pRefs) { delete []m_pRefs; m_pRefs = NULL; }
+    m_nFeatures = 0; 
+}
+
+void SHAREDLOOKUP::Init(RCFEATURE * const *ppFeatures, int numFeatures)
+{
+    Release(); 
+
+    int numRefs = 0; 
+    for (int i = 0; i < numFeatures; i++) 
+        if (ppFeatures[i]) 
+            numRefs += ppFeatures[i]->m_nRects; 
+    m_pLoadStart = new int [numFeatures+1]; 
+    m_pSumStart = new int [numFeatures+1]; 
+    m_pRefStart = new int [numFeatures+1]; 
+    m_pLoads = new LOAD [MAX_SHARED_CORNERS]; 
+    m_pSums = new SUM [MAX_SHARED_RECTS]; 
+    m_pRefs = new REF [max(numRefs, 1)]; 
+
+    // the slot of a rectangle or corner is its index in these lists. the search is 
+    // quadratic, but over a few hundred entries and only once per model 
+    IRECT *pRects = new IRECT [MAX_SHARED_RECTS]; 
+    int numLoads = 0, numSums = 0, r = 0, f; 
+    m_pLoadStart[0] = m_pSumStart[0] = m_pRefStart[0] = 0; 
+    for (f = 0; f < numFeatures; f++) 
+    {
+        RCFEATURE *pF = ppFeatures[f]; 
+        int nRects = pF ? pF->m_nRects : 0; 
+
+        // whatever this feature adds is dropped again if it doesn't fit 
+        int newLoads = numLoads, newSums = numSums; 
+        bool bFits = true; 
+        for (int j = 0; j < nRects && bFits; j++) 
+        {
+            const IRECT &rc = pF->m_wRectArray[j].m_rect; 
+            int k; 
+            for (k = 0; k < newSums; k++) 
+                if (pRects[k].m_ixMin == rc.m_ixMin && pRects[k].m_ixMax == rc.m_ixMax && 
+                    pRects[k].m_iyMin == rc.m_iyMin && pRects[k].m_iyMax == rc.m_iyMax) 
+                    break; 
+            if (k == newSums) 
+            {
+                if (newSums == MAX_SHARED_RECTS) 
+                {
+                    bFits = false; 
+                    break; 
+                }
+                pRects[k] = rc; 
+                m_pSums[k].m_nSlot = k; 
+                int xs[4] = { rc.m_ixMin, rc.m_ixMin, rc.m_ixMax, rc.m_ixMax }; 
+                int ys[4] = { rc.m_iyMin, rc.m_iyMax, rc.m_iyMin, rc.m_iyMax }; 
+                for (int c = 0; c < 4 && bFits; c++) 
+                {
+                    int l; 
+                    for (l = 0; l < newLoads; l++) 
+                        if (m_pLoads[l].m_nX == xs[c] && m_pLoads[l].m_nY == ys[c]) 
+                            break; 
+                    if (l == newLoads) 
+                    {
+                        if (newLoads == MAX_SHARED_CORNERS) 
+                        {
+                            bFits = false; 
+                            break; 
+                        }
+                        m_pLoads[l].m_nX = xs[c]; 
+                        m_pLoads[l].m_nY = ys[c]; 
+                        m_pLoads[l].m_nSlot = l; 
+                        newLoads ++; 
+                    }
+                    m_pSums[k].m_nCorner[c] = l; 
+                }
+                newSums ++; 
+            }
+            m_pRefs[r+j].m_weight = pF->m_wRectArray[j].m_weight; 
+            m_pRefs[r+j].m_nSum = k; 
+        }
+        if (!bFits) 
+            break; 
+
+        numLoads = newLoads; 
+        numSums = newSums; 
+        r += nRects; 
+        m_pLoadStart[f+1] = numLoads; 
+        m_pSumStart[f+1] = numSums; 
+        m_pRefStart[f+1] = r; 
+    }
+
+    m_nFeatures = f; 
+    delete []pRects; 
+}
+
+int SHAREDLOOKUP::GetLookups(int feature, bool bShared)
+{
+    ASSERT(feature >= 0 && feature < m_nFeatures); 
+    if (bShared) 
+        return m_pLoadStart[feature+1] - m_pLoadStart[feature]; 
+    return 4 * (m_pRefStart[feature+1] - m_pRefStart[feature]); 
+}
@@ -26,6 +26,13 @@ struct RCFEATURE
     void Init(FILE *file);
     void Init(const RCFEATURE *src, const float scale = 1); 
     void InitSS(const RCFEATURE *src, const float scale = 1);   // initialize sub-sampled feature (used during training)
+    // src mirrored left to right and/or turned clockwise by rotation quarter turns, inside 
+    // a window of width x height (before the transform) 
+    void InitTransform(const RCFEATURE *src, int width, int height, bool bMirror, int rotation); 
+    // src at half resolution, for the integral image subsampled by 2 (I_IMAGE::InitWithSubSample). 
+    // the rectangle sums there are still sums of the full resolution pixels, the weights are 
+    // set so the value comes out as src's on the full image with the same norm 
+    void InitHalf(const RCFEATURE *src); 
     void Write(FILE *file); 
     void Release(); 
 
@@ -36,6 +43,10 @@ struct RCFEATURE
     // CAUTION: in Eval(), x and y are the top left corner of the measured rectangle, the feature's 
     // offset will be added to the (x,y) coordinate 
     float Eval(I_IMAGE *pIImg, float norm=1.0f, int x=0, int y=0); 
+    // Eval() on count windows of one row: window a is at ((pIdx[a]*stepX) >> shift, y) with 
+    // norm pNorm[pIdx[a]], its value goes to pValue[a]. the results are exactly those of Eval() 
+    void  EvalRow(I_IMAGE *pIImg, int y, int stepX, const int *pIdx, const float *pNorm, int count, float *pValue, 
+                  int shift = 0); 
 
     ~RCFEATURE();
 };
@@ -63,3 +74,81 @@ struct FEATURE
     FEATURE(); 
     ~FEATURE(); 
 }; 
+
+/******************************************************************************\
+*
+*   SHAREDLOOKUP
+*
+*       A run of RCFEATUREs that is always evaluated in order on one window, 
+*       the leading stages of a cascade, compiled so that every distinct 
+*       corner of the integral image is read once and every distinct 
+*       rectangle summed once per window. Neighbouring Haar features share 
+*       most of their corners. 
+*
+*       Since the features are evaluated in order and a window can only stop 
+*       early, the first reference to a corner or rectangle is known at compile 
+*       time: it reads the integral and fills a slot, the later references 
+*       read the slot. No per-window bookkeeping is needed, only the caller's 
+*       slot arrays, and the values are exactly those of RCFEATURE::Eval(). 
+*
+\******************************************************************************/
+
+#define MAX_SHARED_CORNERS                  1024
+#define MAX_SHARED_RECTS                    512
+
+struct SHAREDLOOKUP
+{
+    struct LOAD                             // read a corner of the integral image into a slot 
+    {
+        int     m_nX; 
+        int     m_nY; 
+        int     m_nSlot; 
+    }; 
+    struct SUM                              // sum a rectangle from the corner slots 
+    {
+        int     m_nSlot; 
+        int     m_nCorner[4];               // (x0,y0), (x0,y1), (x1,y0), (x1,y1) 
+    }; 
+    struct REF                              // add a weighted rectangle sum to the feature value 
+    {
+        float   m_weight; 
+        int     m_nSum; 
+    }; 
+
+    int         m_nFeatures;                // features compiled, may be fewer than asked for 
+    int       * m_pLoadStart;               // the loads of feature i are [m_pLoadStart[i], m_pLoadStart[i+1]), 
+    int       * m_pSumStart;                // the same for the sums and references 
+    int       * m_pRefStart; 
+    LOAD      * m_pLoads; 
+    SUM       * m_pSums; 
+    REF       * m_pRefs; 
+
+    SHAREDLOOKUP(); 
+    ~SHAREDLOOKUP(); 
+    void Release(); 
+
+    // compile the leading features, ppFeatures[i] is NULL for a feature without rectangles. 
+    // stops at the first feature whose corners or rectangles don't fit in the slots 
+    void Init(RCFEATURE * const *ppFeatures, int numFeatures); 
+    // integral image reads of feature i, with and without the sharing 
+    int  GetLookups(int feature, bool bShared); 
+
+    // same as ppFeatures[feature]->Eval(), the features before it must have been evaluated 
+    // on this window with the same slot arrays 
+    inline float Eval(int feature, const unsigned int *pData, int nIWidth, float norm, int x, int y, 
+                      unsigned int *pCorner, float *pSum) 
+    {
+        const unsigned int *pBase = pData + y*nIWidth + x; 
+        for (int i = m_pLoadStart[feature]; i < m_pLoadStart[feature+1]; i++) 
+            pCorner[m_pLoads[i].m_nSlot] = pBase[m_pLoads[i].m_nY*nIWidth + m_pLoads[i].m_nX]; 
+        for (int i = m_pSumStart[feature]; i < m_pSumStart[feature+1]; i++) 
+        {
+            const int *c = m_pSums[i].m_nCorner; 
+            pSum[m_pSums[i].m_nSlot] = (float)((pCorner[c[3]] - pCorner[c[1]]) - (pCorner[c[2]] - pCorner[c[0]])); 
+        }
+        float value = 0.0f; 
+        for (int i = m_pRefStart[feature]; i < m_pRefStart[feature+1]; i++) 
+            value += m_pRefs[i].m_weight * pSum[m_pRefs[i].m_nSum]; 
+        return value*norm; 
+    }
+}; 
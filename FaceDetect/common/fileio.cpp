@@ -0,0 +1,143 @@
+/******************************************************************************\
+*
+*   Whole-file binary read/write
+*
+\******************************************************************************/
+
+#include "stdafx.h"
+#include "fileio.h"
+
+#if !defined(_WIN32)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#define FILEIO_CHUNK_SIZE       (64*1024*1024)
+
+#if defined(_WIN32)
+
+bool GetBinaryFileSize(const char *szFileName, size_t *pSize)
+{
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (!GetFileAttributesEx(szFileName, GetFileExInfoStandard, &fad))
+        return false;
+    ULONGLONG size = ((ULONGLONG)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+    if (size > (ULONGLONG)(size_t)-1)
+        return false;
+    *pSize = (size_t)size;
+    return true;
+}
+
+bool ReadBinaryFile(const char *szFileName, void *pBuf, size_t size)
+{
+    HANDLE hFile = CreateFile(szFileName,       // file name
+                    GENERIC_READ,               // open for read
+                    FILE_SHARE_READ,            // share for read
+                    NULL,                       // no security
+                    OPEN_EXISTING,              // the file must exist
+                    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,     // normal file, sequencial scan
+                    NULL);                      // no attr. template
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    char *p = (char *)pBuf;
+    while (size > 0)
+    {
+        DWORD numBytes = (DWORD)min(size, (size_t)FILEIO_CHUNK_SIZE);
+        DWORD numBytesRead = 0;
+        if (!ReadFile(hFile, p, numBytes, &numBytesRead, NULL) || numBytesRead == 0)
+            break;
+        p += numBytesRead;
+        size -= numBytesRead;
+    }
+    CloseHandle(hFile);
+    return size == 0;
+}
+
+bool WriteBinaryFile(const char *szFileName, const void *pBuf, size_t size)
+{
+    HANDLE hFile = CreateFile(szFileName,       // file name
+                    GENERIC_WRITE,              // open for write
+                    FILE_SHARE_WRITE,           // share for write
+                    NULL,                       // no security
+                    CREATE_ALWAYS,              // always create
+                    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,     // normal file, sequencial scan
+                    NULL);                      // no attr. template
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    const char *p = (const char *)pBuf;
+    while (size > 0)
+    {
+        DWORD numBytes = (DWORD)min(size, (size_t)FILEIO_CHUNK_SIZE);
+        DWORD numBytesWritten = 0;
+        if (!WriteFile(hFile, p, numBytes, &numBytesWritten, NULL) || numBytesWritten == 0)
+            break;
+        p += numBytesWritten;
+        size -= numBytesWritten;
+    }
+    CloseHandle(hFile);
+    return size == 0;
+}
+
+#else   // !_WIN32
+
+bool GetBinaryFileSize(const char *szFileName, size_t *pSize)
+{
+    struct stat st;
+    if (stat(szFileName, &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    *pSize = (size_t)st.st_size;
+    return true;
+}
+
+bool ReadBinaryFile(const char *szFileName, void *pBuf, size_t size)
+{
+    int fd = open(szFileName, O_RDONLY);
+    if (fd < 0)
+        return false;
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    char *p = (char *)pBuf;
+    while (size > 0)
+    {
+        ssize_t numBytesRead = read(fd, p, min(size, (size_t)FILEIO_CHUNK_SIZE));
+        if (numBytesRead < 0 && errno == EINTR)
+            continue;
+        if (numBytesRead <= 0)
+            break;
+        p += numBytesRead;
+        size -= numBytesRead;
+    }
+    close(fd);
+    return size == 0;
+}
+
+bool WriteBinaryFile(const char *szFileName, const void *pBuf, size_t size)
+{
+    int fd = open(szFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+
+    const char *p = (const char *)pBuf;
+    while (size > 0)
+    {
+        ssize_t numBytesWritten = write(fd, p, min(size, (size_t)FILEIO_CHUNK_SIZE));
+        if (numBytesWritten < 0 && errno == EINTR)
+            continue;
+        if (numBytesWritten <= 0)
+            break;
+        p += numBytesWritten;
+        size -= numBytesWritten;
+    }
+    if (close(fd) != 0)
+        return false;
+    return size == 0;
+}
+
+#endif  // _WIN32
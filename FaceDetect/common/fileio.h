@@ -0,0 +1,23 @@
+#pragma once
+
+/******************************************************************************\
+*
+*   Whole-file binary read/write
+*
+*       Used for the large intermediate files of the trainer (score files may
+*       exceed 4GB). Files are opened for sequential access and transferred in
+*       chunks, so the sizes are not limited by the 32-bit ReadFile/WriteFile
+*       counts on Windows or by short reads elsewhere.
+*
+\******************************************************************************/
+
+#include "platform.h"
+
+// size of szFileName in bytes, return false if it can't be queried
+bool    GetBinaryFileSize(const char *szFileName, size_t *pSize);
+
+// read exactly size bytes from the beginning of szFileName, return false on any failure
+bool    ReadBinaryFile(const char *szFileName, void *pBuf, size_t size);
+
+// create (or truncate) szFileName and write size bytes to it, return false on any failure
+bool    WriteBinaryFile(const char *szFileName, const void *pBuf, size_t size);
@@ -5,7 +5,7 @@
 \******************************************************************************/
 
 #include "stdafx.h"
-#include <windows.h>
+#include "platform.h"
 #include "image.h"
 
 #ifndef _NO_LIBJPEG
@@ -646,11 +646,11 @@ void IMAGE::ScaleToImage(IMAGE *pSImg, int scaleFactor, bool bVFlip)
         pSImg->Realloc(nSWidth, nSHeight); 
 
     int nStartRow = 0; 
-    int nEndRow = m_height; 
+    int nEndRow = nSHeight; 
     int nStep = 1; 
     if (bVFlip) 
     {
-        nStartRow = m_height-1; 
+        nStartRow = nSHeight-1; 
         nEndRow = -1; 
         nStep = -1; 
     }
@@ -711,6 +711,207 @@ void IMAGE::CropToImage(IMAGE *pCImg, const IRECT *pRect, bool bVFlip)
 
 }
 
+/******************************************************************************\
+*
+*   IMAGE::ResampleToImage
+*
+*   Separable resampling with fixed point weights, both axes use weights that 
+*   sum to 1<<14. Each output row is first blended vertically from its source 
+*   rows into a 16-bit row of the source width that keeps 8 fractional bits, 
+*   then filtered horizontally and rounded. The vertical pass runs over 
+*   contiguous pixels and does 16 at a time with SSE2, two source rows per 
+*   multiply-add; the horizontal pass only produces the output width. 
+*
+*   Along each axis the taps are either the exact area overlap of the output 
+*   pixel with the source pixels, or the two bilinear neighbours of the output 
+*   pixel center. An integer reduction by 2, 4 or 8 therefore gives exactly 
+*   the box average of ScaleToImage. 
+*
+\******************************************************************************/
+
+#define RESAMPLE_WBITS      14
+#define RESAMPLE_VSHIFT     6       // drop after the vertical pass, 255<<8 still fits 16 bits 
+
+static int ResampleMaxTaps(int srcSize, int dstSize)
+{
+    if (srcSize >= RESAMPLE_AREA_MIN_RATIO*dstSize) 
+        return (srcSize+dstSize-1)/dstSize + 1; 
+    return 2; 
+}
+
+// first source pixel, number of taps and maxTaps weights for each of the dstSize output pixels 
+static void ResampleTaps(int srcSize, int dstSize, int maxTaps, 
+                         int *pFirst, int *pCount, unsigned short *pWeights)
+{
+    const int one = 1 << RESAMPLE_WBITS; 
+    bool bArea = srcSize >= RESAMPLE_AREA_MIN_RATIO*dstSize; 
+
+    for (int d=0; d<dstSize; d++) 
+    {
+        unsigned short *pW = pWeights + d*maxTaps; 
+        memset(pW, 0, maxTaps*sizeof(unsigned short)); 
+        if (bArea) 
+        {
+            // in units of 1/dstSize source pixel, output pixel d covers [x0, x1) 
+            I2TYPE x0 = (I2TYPE)d*srcSize; 
+            I2TYPE x1 = x0 + srcSize; 
+            int first = (int)(x0/dstSize); 
+            int end = (int)((x1+dstSize-1)/dstSize); 
+            pFirst[d] = first; 
+            pCount[d] = end - first; 
+            // round the running overlap rather than each tap, so the weights add up to exactly one 
+            int w0 = 0; 
+            for (int k=0; k<end-first; k++) 
+            {
+                I2TYPE s1 = min(x1, (I2TYPE)(first+k+1)*dstSize); 
+                int w1 = (int)(((s1-x0)*one + srcSize/2)/srcSize); 
+                pW[k] = (unsigned short)(w1 - w0); 
+                w0 = w1; 
+            }
+        }
+        else
+        {
+            // output pixel centers mapped into the source: ((2d+1)*srcSize - dstSize) / (2*dstSize) 
+            I2TYPE num = (I2TYPE)(2*d+1)*srcSize - dstSize; 
+            I2TYPE den = 2*(I2TYPE)dstSize; 
+            if (num < 0) 
+                num = 0; 
+            int first = (int)(num/den); 
+            if (first >= srcSize-1) 
+            {
+                pFirst[d] = srcSize-1; 
+                pCount[d] = 1; 
+                pW[0] = (unsigned short)one; 
+            }
+            else 
+            {
+                unsigned short w1 = (unsigned short)(((num%den)*one + den/2)/den); 
+                pFirst[d] = first; 
+                pCount[d] = 2; 
+                pW[0] = (unsigned short)(one - w1); 
+                pW[1] = w1; 
+            }
+        }
+    }
+}
+
+#if defined(USE_SSE2)
+// 32-bit lanes to 16 bits for values up to 0xffff, SSE2 only has the signed saturating pack 
+static inline __m128i PackU32(__m128i lo, __m128i hi)
+{
+    const __m128i bias32 = _mm_set1_epi32(0x8000); 
+    const __m128i bias16 = _mm_set1_epi16((short)0x8000); 
+    return _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(lo, bias32), _mm_sub_epi32(hi, bias32)), bias16); 
+}
+#endif
+
+// weighted sum of numTaps source rows, in 1/256 gray levels 
+static void ResampleRowsV(const BYTE * const *ppSrc, const unsigned short *pWeights, int numTaps, 
+                          int width, unsigned short *pDst)
+{
+    const unsigned int rnd = 1 << (RESAMPLE_VSHIFT-1); 
+    int iX = 0; 
+#if defined(USE_SSE2)
+    const __m128i zero = _mm_setzero_si128(); 
+    const __m128i vRnd = _mm_set1_epi32(rnd); 
+    for (; iX+16 <= width; iX += 16) 
+    {
+        __m128i acc0 = vRnd, acc1 = vRnd, acc2 = vRnd, acc3 = vRnd; 
+        for (int k=0; k<numTaps; k+=2) 
+        {
+            // rows k and k+1 interleaved, so one madd applies both weights; an odd last row pairs with itself at weight 0 
+            int k1 = (k+1 < numTaps) ? k+1 : k; 
+            int w1 = (k+1 < numTaps) ? pWeights[k+1] : 0; 
+            __m128i w = _mm_set1_epi32((w1 << 16) | pWeights[k]); 
+            __m128i a = _mm_loadu_si128((const __m128i *)(ppSrc[k]+iX)); 
+            __m128i b = _mm_loadu_si128((const __m128i *)(ppSrc[k1]+iX)); 
+            __m128i ab = _mm_unpacklo_epi8(a, b);       // a0 b0 a1 b1 ... as bytes 
+            acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi8(ab, zero), w)); 
+            acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi8(ab, zero), w)); 
+            ab = _mm_unpackhi_epi8(a, b); 
+            acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi8(ab, zero), w)); 
+            acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi8(ab, zero), w)); 
+        }
+        acc0 = _mm_srli_epi32(acc0, RESAMPLE_VSHIFT); 
+        acc1 = _mm_srli_epi32(acc1, RESAMPLE_VSHIFT); 
+        acc2 = _mm_srli_epi32(acc2, RESAMPLE_VSHIFT); 
+        acc3 = _mm_srli_epi32(acc3, RESAMPLE_VSHIFT); 
+        _mm_storeu_si128((__m128i *)(pDst+iX), PackU32(acc0, acc1)); 
+        _mm_storeu_si128((__m128i *)(pDst+iX+8), PackU32(acc2, acc3)); 
+    }
+#endif
+    for (; iX < width; iX++) 
+    {
+        unsigned int sum = rnd; 
+        for (int k=0; k<numTaps; k++) 
+            sum += pWeights[k]*ppSrc[k][iX]; 
+        pDst[iX] = (unsigned short)(sum >> RESAMPLE_VSHIFT); 
+    }
+}
+
+static void ResampleRowH(const unsigned short *pSrc, const int *pFirst, const int *pCount, 
+                         const unsigned short *pWeights, int maxTaps, int width, BYTE *pDst)
+{
+    const int shift = 2*RESAMPLE_WBITS - RESAMPLE_VSHIFT; 
+    const unsigned int rnd = 1 << (shift-1); 
+    for (int iX=0; iX<width; iX++) 
+    {
+        const unsigned short *p = pSrc + pFirst[iX]; 
+        const unsigned short *pW = pWeights + iX*maxTaps; 
+        unsigned int sum = rnd; 
+        for (int k=0; k<pCount[iX]; k++) 
+            sum += pW[k]*p[k]; 
+        pDst[iX] = (BYTE)(sum >> shift); 
+    }
+}
+
+void IMAGE::ResampleToImage(IMAGE *pRImg, int width, int height, const IRECT *pSrcRect)
+{
+    ASSERT(pRImg != this); 
+    IRECT rc(0, m_width, 0, m_height); 
+    if (pSrcRect) 
+    {
+        rc = *pSrcRect; 
+        rc.Clamp(0, 0, m_width, m_height); 
+    }
+    int srcWidth = rc.Width(); 
+    int srcHeight = rc.Height(); 
+    if (srcWidth <= 0 || srcHeight <= 0 || width <= 0 || height <= 0) 
+        throw "Invalid resample size"; 
+    if (width != pRImg->GetWidth() || height != pRImg->GetHeight()) 
+        pRImg->Realloc(width, height); 
+
+    int maxTapsX = ResampleMaxTaps(srcWidth, width); 
+    int maxTapsY = ResampleMaxTaps(srcHeight, height); 
+    int *pFirstX = new int [2*width]; 
+    int *pFirstY = new int [2*height]; 
+    unsigned short *pWeightsX = new unsigned short [width*maxTapsX]; 
+    unsigned short *pWeightsY = new unsigned short [height*maxTapsY]; 
+    unsigned short *pRow = new unsigned short [srcWidth]; 
+    const BYTE **ppSrc = new const BYTE * [maxTapsY]; 
+    int *pCountX = pFirstX + width; 
+    int *pCountY = pFirstY + height; 
+
+    ResampleTaps(srcWidth, width, maxTapsX, pFirstX, pCountX, pWeightsX); 
+    ResampleTaps(srcHeight, height, maxTapsY, pFirstY, pCountY, pWeightsY); 
+
+    for (int iY=0; iY<height; iY++) 
+    {
+        for (int k=0; k<pCountY[iY]; k++) 
+            ppSrc[k] = m_bData + (rc.m_iyMin+pFirstY[iY]+k)*m_stride + rc.m_ixMin; 
+        ResampleRowsV(ppSrc, pWeightsY + iY*maxTapsY, pCountY[iY], srcWidth, pRow); 
+        ResampleRowH(pRow, pFirstX, pCountX, pWeightsX, maxTapsX, width, 
+                     pRImg->GetDataPtr() + iY*pRImg->GetStride()); 
+    }
+
+    delete []ppSrc; 
+    delete []pRow; 
+    delete []pWeightsY; 
+    delete []pWeightsX; 
+    delete []pFirstY; 
+    delete []pFirstX; 
+}
+
 void IMAGE::ConvertYFromC(IMAGEC *pImgC, bool bVFlip)
 {
 	using namespace color_conv; 
@@ -844,6 +1045,137 @@ void I_IMAGE::Release()
     m_memSize = 0;
 }
 
+/******************************************************************************\
+*
+*   IntegralRow, IntegralRow2, IntegralRow2C
+*
+*   Compute one row of the integral image (and of the squared integral image) 
+*   from one row of pixels. pDst points to the first pixel column of the row 
+*   and the row above is rowStep entries back. The SSE2 path handles four 
+*   pixels at a time: two shifted adds give the prefix sums inside the 
+*   register, the running row sum is carried from block to block in all 
+*   lanes, and the row above is added last. Everything is integer arithmetic 
+*   so the result is identical to the C loop. 
+*
+\******************************************************************************/
+
+#if defined(USE_SSE2)
+static inline __m128i PrefixSum4(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_slli_si128(v, 4)); 
+    return _mm_add_epi32(v, _mm_slli_si128(v, 8)); 
+}
+
+// four gray bytes to four 32-bit lanes 
+static inline __m128i LoadGray4(const BYTE *pSrc)
+{
+    const __m128i zero = _mm_setzero_si128(); 
+    __m128i v = _mm_cvtsi32_si128(*(const int *)pSrc); 
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero); 
+}
+
+// v holds four pixel values, rowSum the sum of all pixels left of them in every lane 
+static inline void Integral4(__m128i v, __m128i &rowSum, unsigned int *pDst, int rowStep)
+{
+    __m128i sum = _mm_add_epi32(PrefixSum4(v), rowSum); 
+    __m128i above = _mm_loadu_si128((const __m128i *)(pDst-rowStep)); 
+    _mm_storeu_si128((__m128i *)pDst, _mm_add_epi32(sum, above)); 
+    rowSum = _mm_shuffle_epi32(sum, _MM_SHUFFLE(3,3,3,3)); 
+}
+
+// same for the squares, rowSum2 holds the 64-bit running sum in both lanes 
+static inline void Integral4Sq(__m128i v, __m128i &rowSum2, I2TYPE *pDst, int rowStep)
+{
+    const __m128i zero = _mm_setzero_si128(); 
+
+    // the upper 16 bits of each lane are zero, so the madd is just v*v; four of them fit 32 bits 
+    __m128i sq = PrefixSum4(_mm_madd_epi16(v, v)); 
+    __m128i lo = _mm_add_epi64(_mm_unpacklo_epi32(sq, zero), rowSum2); 
+    __m128i hi = _mm_add_epi64(_mm_unpackhi_epi32(sq, zero), rowSum2); 
+    _mm_storeu_si128((__m128i *)pDst, _mm_add_epi64(lo, _mm_loadu_si128((const __m128i *)(pDst-rowStep)))); 
+    _mm_storeu_si128((__m128i *)(pDst+2), _mm_add_epi64(hi, _mm_loadu_si128((const __m128i *)(pDst+2-rowStep)))); 
+    rowSum2 = _mm_unpackhi_epi64(hi, hi); 
+}
+#endif
+
+static void IntegralRow(const BYTE *pSrc, int width, unsigned int *pDst, int rowStep)
+{
+    unsigned int rowSum = 0; 
+    int iX = 0; 
+#if defined(USE_SSE2)
+    __m128i vRowSum = _mm_setzero_si128(); 
+    for (; iX+4 <= width; iX += 4) 
+        Integral4(LoadGray4(pSrc+iX), vRowSum, pDst+iX, rowStep); 
+    rowSum = (unsigned int)_mm_cvtsi128_si32(vRowSum); 
+#endif
+    for (; iX < width; iX++)
+    {
+        rowSum += pSrc[iX];
+        pDst[iX] = rowSum + pDst[iX-rowStep];
+    }
+}
+
+// the pixels come either from the bytes pSrc or from the 32-bit values pLuma, which may alias pDst 
+static void IntegralRow2(const BYTE *pSrc, const unsigned int *pLuma, int width, 
+                         unsigned int *pDst, I2TYPE *pDst2, int rowStep)
+{
+    unsigned int rowSum = 0; 
+    I2TYPE rowSum2 = 0; 
+    int iX = 0; 
+#if defined(USE_SSE2)
+    __m128i vRowSum = _mm_setzero_si128(); 
+    __m128i vRowSum2 = _mm_setzero_si128(); 
+    for (; iX+4 <= width; iX += 4) 
+    {
+        __m128i v = pSrc ? LoadGray4(pSrc+iX) : _mm_loadu_si128((const __m128i *)(pLuma+iX)); 
+        Integral4(v, vRowSum, pDst+iX, rowStep); 
+        Integral4Sq(v, vRowSum2, pDst2+iX, rowStep); 
+    }
+    rowSum = (unsigned int)_mm_cvtsi128_si32(vRowSum); 
+    _mm_storel_epi64((__m128i *)&rowSum2, vRowSum2); 
+#endif
+    for (; iX < width; iX++)
+    {
+        unsigned int v = pSrc ? pSrc[iX] : pLuma[iX]; 
+        rowSum += v;
+        rowSum2 += v*v;
+        pDst[iX] = rowSum + pDst[iX-rowStep];
+        pDst2[iX] = rowSum2 + pDst2[iX-rowStep];
+    }
+}
+
+// compact norm data: 32-bit integral of (v-128)^2, it wraps around on large images 
+static void IntegralRow2C(const BYTE *pSrc, const unsigned int *pLuma, int width, 
+                          unsigned int *pDst, unsigned int *pDst2, int rowStep)
+{
+    unsigned int rowSum = 0; 
+    unsigned int rowSum2 = 0; 
+    int iX = 0; 
+#if defined(USE_SSE2)
+    const __m128i bias = _mm_set1_epi32(128*128); 
+    __m128i vRowSum = _mm_setzero_si128(); 
+    __m128i vRowSum2 = _mm_setzero_si128(); 
+    for (; iX+4 <= width; iX += 4) 
+    {
+        __m128i v = pSrc ? LoadGray4(pSrc+iX) : _mm_loadu_si128((const __m128i *)(pLuma+iX)); 
+        Integral4(v, vRowSum, pDst+iX, rowStep); 
+        // (v-128)^2 = v^2 - 256*v + 16384, keeps the madd on non-negative 16-bit values 
+        __m128i sq = _mm_sub_epi32(_mm_add_epi32(_mm_madd_epi16(v, v), bias), _mm_slli_epi32(v, 8)); 
+        Integral4(sq, vRowSum2, pDst2+iX, rowStep); 
+    }
+    rowSum = (unsigned int)_mm_cvtsi128_si32(vRowSum); 
+    rowSum2 = (unsigned int)_mm_cvtsi128_si32(vRowSum2); 
+#endif
+    for (; iX < width; iX++)
+    {
+        int v = pSrc ? pSrc[iX] : (int)pLuma[iX]; 
+        rowSum += v;
+        rowSum2 += (v-128)*(v-128);
+        pDst[iX] = rowSum + pDst[iX-rowStep];
+        pDst2[iX] = rowSum2 + pDst2[iX-rowStep];
+    }
+}
+
 /******************************************************************************\
 *
 *   public method I_IMAGE::Init(IMAGE*)
@@ -875,12 +1207,8 @@ void I_IMAGE::Init(const IMAGE* pImage)
     for (int iY = 0; iY < height0; iY++)
     {
         *(pIImgData++) = 0;         // skip first column 
-        unsigned int rowSum = 0;
-        for (int iX = 0; iX < width0; iX++, pIImgData++)
-        {
-            rowSum += pImgData[iX];
-            *pIImgData = rowSum + *(pIImgData-m_width);
-        }
+        IntegralRow(pImgData, width0, pIImgData, m_width); 
+        pIImgData += width0; 
         pImgData += image.GetStride(); 
     }
 }
@@ -909,6 +1237,93 @@ void I_IMAGE::InitWithSubSample(const IN_IMAGE* pIImage, int x, int y, float sca
     }
 }
 
+/******************************************************************************\
+*
+*   public method I_IMAGE::InitSkinMask(const BYTE*, int, int, int, PIXEL_FORMAT)
+*
+*   Initialize the integral image of a mask that is 1 on the skin colored 
+*   pixels and 0 elsewhere. RGB is taken to U and V with the color_conv 
+*   tables, the YUV formats are read as they are. 
+*
+\******************************************************************************/
+
+static inline unsigned int IsSkin(int u, int v)
+{
+    return (u >= SKIN_U_MIN && u <= SKIN_U_MAX && v >= SKIN_V_MIN && v <= SKIN_V_MAX) ? 1 : 0; 
+}
+
+void I_IMAGE::InitSkinMask(const BYTE* pData, int width, int height, int stride, PIXEL_FORMAT format)
+{
+    using namespace color_conv; 
+    if (!init)  // the tables haven't been initialized 
+        init_color_conv();
+
+    int r, g, b, bpp; 
+    switch (format) 
+    {
+    case PIXFMT_RGB24:  r = 0; g = 1; b = 2; bpp = 3; break; 
+    case PIXFMT_BGR24:  r = 2; g = 1; b = 0; bpp = 3; break; 
+    case PIXFMT_BGRA32: r = 2; g = 1; b = 0; bpp = 4; break; 
+    case PIXFMT_RGBA32: r = 0; g = 1; b = 2; bpp = 4; break; 
+    case PIXFMT_YUV24:  r = g = b = 0; bpp = 3; break; 
+    case PIXFMT_YUYV:   r = g = b = 0; bpp = 2; break; 
+    case PIXFMT_GRAY8:  throw "No color in the source pixel format"; 
+    default:            throw "Unknown source pixel format"; 
+    }
+
+    if (m_width != width+1 || m_height != height+1)
+        Realloc(width, height); 
+
+    unsigned int *pIImgData = m_iData; 
+
+    // set first row to be zero 
+    for (int iX = 0; iX < m_width; iX++) 
+        *(pIImgData++) = 0; 
+
+    for (int iY = 0; iY < height; iY++, pData += stride)
+    {
+        *(pIImgData++) = 0;         // skip first column 
+        const BYTE *pSrc = pData; 
+        unsigned int rowSum = 0; 
+        for (int iX = 0; iX < width; iX++, pSrc += bpp) 
+        {
+            int u, v; 
+            if (format == PIXFMT_YUV24) 
+            {
+                u = pSrc[1]; 
+                v = pSrc[2]; 
+            }
+            else if (format == PIXFMT_YUYV)     // both pixels of a pair share U and V 
+            {
+                const BYTE *pPair = pData + (iX & ~1)*2; 
+                u = pPair[1]; 
+                v = pPair[3]; 
+            }
+            else
+            {
+                u = (fast_rgb2yuv_r_u[pSrc[r]]+fast_rgb2yuv_g_u[pSrc[g]]+fast_rgb2yuv_b_u[pSrc[b]])>>8; 
+                v = (fast_rgb2yuv_r_v[pSrc[r]]+fast_rgb2yuv_g_v[pSrc[g]]+fast_rgb2yuv_b_v[pSrc[b]])>>8; 
+            }
+            rowSum += IsSkin(u, v); 
+            *pIImgData = *(pIImgData-m_width) + rowSum; 
+            pIImgData ++; 
+        }
+    }
+}
+
+void I_IMAGE::InitSkinMask(const IMAGEC* pImgC)
+{
+    PIXEL_FORMAT format; 
+    switch (pImgC->GetColorSpace()) 
+    {
+    case IMAGEC::RGB:   format = PIXFMT_RGB24; break; 
+    case IMAGEC::BGR:   format = PIXFMT_BGR24; break; 
+    case IMAGEC::YUV:   format = PIXFMT_YUV24; break; 
+    default:            throw "Unknown color space"; 
+    }
+    InitSkinMask(pImgC->GetDataPtr(), pImgC->GetWidth(), pImgC->GetHeight(), pImgC->GetStride(), format); 
+}
+
 ///******************************************************************************\
 //*
 //*   public method I_IMAGE::Init(IMAGE*, IMAGE*)
@@ -967,7 +1382,9 @@ unsigned int I_IMAGE::GetValue(int x, int y) const
 ********************************************************************************/
 
 IN_IMAGE::IN_IMAGE() :
-m_llData(NULL)
+m_llData(NULL),
+m_bCompactNorm(false),
+m_iData2(NULL)
 {
 }
 
@@ -978,7 +1395,9 @@ m_llData(NULL)
 \******************************************************************************/
 
 IN_IMAGE::IN_IMAGE(int width, int height) :
-m_llData(NULL)
+m_llData(NULL),
+m_bCompactNorm(false),
+m_iData2(NULL)
 {
     Realloc(width, height); 
 }
@@ -1005,10 +1424,14 @@ bool IN_IMAGE::Realloc(int width, int height)
     if (m_memSize < memSize) 
     {   // need to re-alloc the memory 
         if (m_iData) delete []m_iData; 
-        if (m_llData) delete []m_llData; 
+        if (m_llData) { delete []m_llData; m_llData = NULL; }
+        if (m_iData2) { delete []m_iData2; m_iData2 = NULL; }
         m_iData = new unsigned int [memSize];
-        m_llData = new I2TYPE [memSize];
-        if (!m_iData || !m_llData) 
+        if (m_bCompactNorm) 
+            m_iData2 = new unsigned int [memSize];
+        else
+            m_llData = new I2TYPE [memSize];
+        if (!m_iData || (!m_llData && !m_iData2)) 
         {
             throw "memory allocation failure"; 
             return false; 
@@ -1022,53 +1445,249 @@ void IN_IMAGE::Release()
 {
     if (m_iData) { delete []m_iData; m_iData=NULL; }
     if (m_llData) { delete []m_llData; m_llData=NULL; }
+    if (m_iData2) { delete []m_iData2; m_iData2=NULL; }
     m_height = 0; 
     m_width = 0; 
     m_memSize = 0;
 }
 
+void IN_IMAGE::SetCompactNorm(bool bCompact)
+{
+    if (bCompact != m_bCompactNorm) 
+    {
+        Release();      // the tables are allocated again in the other layout 
+        m_bCompactNorm = bCompact; 
+    }
+}
+
 void IN_IMAGE::Init(const IMAGE* pImage)
 {
-    const IMAGE& image = *pImage;
-    int width0 = image.GetWidth(); 
-    int height0 = image.GetHeight();
-    if (m_width != width0+1 || m_height != height0+1)
-        Realloc(width0, height0); 
+    Init(pImage->GetDataPtr(), pImage->GetWidth(), pImage->GetHeight(), pImage->GetStride(), PIXFMT_GRAY8); 
+}
 
-    BYTE *pImgData = image.GetDataPtr(); 
-    unsigned int *pIImgData = m_iData; 
-    I2TYPE *pI2ImgData = m_llData; 
+/******************************************************************************\
+*
+*   ConvertRowToLuma
+*
+*   Converts one row of color pixels to luminance. The weights are the ITU-R 
+*   BT.601 ones with the same fixed point rounding libjpeg uses for grayscale 
+*   output, so a color buffer gives the same gray levels as IMAGE::LoadJPG. 
+*   The SSE2 path computes exactly the same integers as the C loop. 
+*
+\******************************************************************************/
+
+#define LUMA_R      19595       // FIX(0.299) 
+#define LUMA_G      38470       // FIX(0.587) 
+#define LUMA_B      7471        // FIX(0.114) 
+
+#if defined(USE_SSE2)
+// four pixels with 4 bytes each (the 4th byte is ignored) to four 32-bit luma values 
+// coef holds the weights in 16-bit lanes as {c0, G/2, c2, G/2} for both pixel pairs, where c0/c2 
+// are the weights of byte 0 and byte 2. G is split so that every weight fits a signed 16-bit madd 
+static inline __m128i Luma4(__m128i px, __m128i coef)
+{
+    const __m128i zero = _mm_setzero_si128(); 
+    const __m128i half = _mm_set1_epi32(1<<15); 
+
+    // {b0 g0 r0 x0 b1 g1 r1 x1} -> {b0 g0 r0 g0 b1 g1 r1 g1} 
+    __m128i lo = _mm_unpacklo_epi8(px, zero); 
+    __m128i hi = _mm_unpackhi_epi8(px, zero); 
+    lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(1,2,1,0)), _MM_SHUFFLE(1,2,1,0)); 
+    hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(1,2,1,0)), _MM_SHUFFLE(1,2,1,0)); 
+
+    // {b*cb+g*cg/2, r*cr+g*cg/2} per pixel, then add the two halves 
+    lo = _mm_madd_epi16(lo, coef); 
+    hi = _mm_madd_epi16(hi, coef); 
+    lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2,3,0,1))); 
+    hi = _mm_add_epi32(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2,3,0,1))); 
+    __m128i sum = _mm_unpacklo_epi64(_mm_shuffle_epi32(lo, _MM_SHUFFLE(3,1,2,0)), 
+                                     _mm_shuffle_epi32(hi, _MM_SHUFFLE(3,1,2,0))); 
+    return _mm_srli_epi32(_mm_add_epi32(sum, half), 16); 
+}
+#endif
+
+static void ConvertRowToLuma(const BYTE *pSrc, int width, PIXEL_FORMAT format, unsigned int *pDst)
+{
+    int r, g, b, bpp; 
+    switch (format) 
+    {
+    case PIXFMT_RGB24:  r = 0; g = 1; b = 2; bpp = 3; break; 
+    case PIXFMT_BGR24:  r = 2; g = 1; b = 0; bpp = 3; break; 
+    case PIXFMT_BGRA32: r = 2; g = 1; b = 0; bpp = 4; break; 
+    case PIXFMT_RGBA32: r = 0; g = 1; b = 2; bpp = 4; break; 
+    case PIXFMT_YUV24:  // packed 4:4:4 as in IMAGEC::YUV, luma is the first byte 
+    case PIXFMT_YUYV:   // packed 4:2:2, luma is every other byte 
+        bpp = (format == PIXFMT_YUV24) ? 3 : 2; 
+        for (int iX = 0; iX < width; iX++, pSrc += bpp) 
+            pDst[iX] = pSrc[0]; 
+        return; 
+    default: 
+        throw "Unknown source pixel format"; 
+    }
+
+    int iX = 0; 
+#if defined(USE_SSE2)
+    const short c0 = (short)(r == 0 ? LUMA_R : LUMA_B); 
+    const short c2 = (short)(r == 0 ? LUMA_B : LUMA_R); 
+    const short cg = (short)(LUMA_G/2); 
+    const __m128i coef = _mm_setr_epi16(c0, cg, c2, cg, c0, cg, c2, cg); 
+    if (bpp == 4) 
+    {
+        for (; iX+4 <= width; iX += 4, pSrc += 16) 
+            _mm_storeu_si128((__m128i *)(pDst+iX), Luma4(_mm_loadu_si128((const __m128i *)pSrc), coef)); 
+    }
+    else
+    {
+        // a 16-byte load covers 5 and a third pixels, stop early enough not to read past the row 
+        for (; iX+6 <= width; iX += 4, pSrc += 12) 
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)pSrc); 
+            __m128i px = _mm_unpacklo_epi64(_mm_unpacklo_epi32(v, _mm_srli_si128(v, 3)), 
+                                            _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9))); 
+            _mm_storeu_si128((__m128i *)(pDst+iX), Luma4(px, coef)); 
+        }
+    }
+#endif
+    for (; iX < width; iX++, pSrc += bpp) 
+        pDst[iX] = (LUMA_R*pSrc[r] + LUMA_G*pSrc[g] + LUMA_B*pSrc[b] + 32768) >> 16; 
+}
+
+void IN_IMAGE::Init(const BYTE* pData, int width, int height, int stride, PIXEL_FORMAT format)
+{
+    BeginRows(width, height); 
+
+    const BYTE *pImgData = pData; 
+    for (int iY = 0; iY < height; iY++, pImgData += stride)
+        AccumulateRow(iY, pImgData, format); 
+}
+
+void IN_IMAGE::BeginRows(int width, int height)
+{
+    if (m_width != width+1 || m_height != height+1)
+        Realloc(width, height); 
 
     // set first row to be zero 
     for (int iX = 0; iX < m_width; iX++) 
+        m_iData[iX] = 0; 
+    if (m_bCompactNorm) 
+        memset(m_iData2, 0, m_width*sizeof(unsigned int)); 
+    else
+        memset(m_llData, 0, m_width*sizeof(I2TYPE)); 
+}
+
+void IN_IMAGE::AccumulateRow(int iY, const BYTE* pSrc, PIXEL_FORMAT format)
+{
+    const int width0 = m_width-1; 
+    unsigned int *pIImgData = m_iData + (iY+1)*m_width; 
+
+    *(pIImgData++) = 0;         // skip first column 
+    const unsigned int *pLuma = NULL; 
+    if (format != PIXFMT_GRAY8) 
     {
-        *(pIImgData++) = 0; 
-        *(pI2ImgData++) = 0; 
+        // the luma row is staged in the integral row itself, each entry is read before it is overwritten 
+        ConvertRowToLuma(pSrc, width0, format, pIImgData); 
+        pLuma = pIImgData; 
+        pSrc = NULL; 
     }
 
-    for (int iY = 0; iY < height0; iY++)
+    if (m_bCompactNorm) 
     {
-        *(pIImgData++) = 0;         // skip first column 
+        unsigned int *pI2ImgData = m_iData2 + (iY+1)*m_width; 
         *(pI2ImgData++) = 0; 
-        unsigned int rowSum = 0;
-        I2TYPE rowSum2 = 0;
-        for (int iX = 0; iX < width0; iX++, pIImgData++, pI2ImgData++)
-        {
-            rowSum += pImgData[iX];
-            rowSum2 += pImgData[iX]*pImgData[iX];
-            *pIImgData = rowSum + *(pIImgData-m_width);
-            *pI2ImgData = rowSum2 + *(pI2ImgData-m_width);
-        }
-        pImgData += image.GetStride(); 
+        IntegralRow2C(pSrc, pLuma, width0, pIImgData, pI2ImgData, m_width); 
+    }
+    else
+    {
+        I2TYPE *pI2ImgData = m_llData + (iY+1)*m_width; 
+        *(pI2ImgData++) = 0; 
+        IntegralRow2(pSrc, pLuma, width0, pIImgData, pI2ImgData, m_width); 
     }
 }
 
+#ifndef _NO_LIBJPEG
+
+void IN_IMAGE::LoadJPG(const char *fileName, int scaleDenom)
+{
+    if (scaleDenom != 1 && scaleDenom != 2 && scaleDenom != 4 && scaleDenom != 8) 
+        throw "Unsupported JPEG scale"; 
+
+    FILE *fp; 
+    if ((fp = fopen (fileName, "rb")) == NULL) 
+        throw "Open file failed"; 
+
+    struct jpeg_decompress_struct cinfo; 
+    struct jpeg_error_mgr jerr; 
+    cinfo.err = jpeg_std_error(&jerr); 
+    jpeg_create_decompress(&cinfo); 
+    jpeg_stdio_src (&cinfo, fp); 
+    jpeg_read_header(&cinfo, TRUE); 
+
+    // force the output format to be grayscale, same as IMAGE::LoadJPG 
+    cinfo.out_color_space = JCS_GRAYSCALE; 
+    cinfo.scale_num = 1; 
+    cinfo.scale_denom = scaleDenom; 
+
+    jpeg_start_decompress(&cinfo); 
+    int width0 = (int)cinfo.output_width; 
+    BeginRows(width0, (int)cinfo.output_height); 
+
+    // one scanline buffer, released by jpeg_destroy_decompress 
+    JSAMPARRAY buffer = (*cinfo.mem->alloc_sarray)((j_common_ptr)&cinfo, JPOOL_IMAGE, width0, 1); 
+    while (cinfo.output_scanline < cinfo.output_height) 
+    {
+        int iY = (int)cinfo.output_scanline; 
+        jpeg_read_scanlines(&cinfo, buffer, 1); 
+        AccumulateRow(iY, buffer[0], PIXFMT_GRAY8); 
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo); 
+    fclose (fp); 
+}
+
+#endif
+
+void IN_IMAGE::Load(const char *fileName)
+{
+#ifndef _NO_LIBJPEG
+    const char *ext = strrchr(fileName, '.'); 
+    if (ext != NULL && _stricmp(ext+1, "jpg") == 0) 
+    {
+        LoadJPG(fileName); 
+        return; 
+    }
+#endif
+    IMAGE image(fileName); 
+    Init(&image); 
+}
+
 I2TYPE IN_IMAGE::GetValue2(int x, int y) const
 {
+    ASSERT(!m_bCompactNorm); 
     const int index = GetIndex(x,y);
     return m_llData[index];
 }
 
+// sum of v^2 over the window from the compact data, exact as long as the 64-bit path is 
+I2TYPE IN_IMAGE::ComputeSum2Compact(IRECT *rc, unsigned int sum)
+{
+    const int width = rc->m_ixMax - rc->m_ixMin; 
+    const int height = rc->m_iyMax - rc->m_iyMin; 
+
+    // sum of (v-128)^2, over strips of rows small enough not to wrap around if need be 
+    I2TYPE sumC = 0; 
+    const int stripHeight = (width*height < COMPACT_NORM_MAX_AREA) ? height : 
+                            max((COMPACT_NORM_MAX_AREA-1)/width, 1); 
+    for (int iY = rc->m_iyMin; iY < rc->m_iyMax; iY += stripHeight) 
+    {
+        const unsigned int *pTop = m_iData2 + iY*m_width; 
+        const unsigned int *pBottom = m_iData2 + min(iY+stripHeight, (int)rc->m_iyMax)*m_width; 
+        sumC += (pBottom[rc->m_ixMax] - pBottom[rc->m_ixMin]) - (pTop[rc->m_ixMax] - pTop[rc->m_ixMin]); 
+    }
+
+    // (v-128)^2 = v^2 - 256*v + 16384 
+    return sumC + 256*(I2TYPE)sum - 16384*(I2TYPE)width*height; 
+}
+
 float IN_IMAGE::ComputeNorm(IRECT *rc)
 {
     const int idx00 = rc->m_iyMin*m_width+rc->m_ixMin; 
@@ -1080,13 +1699,20 @@ float IN_IMAGE::ComputeNorm(IRECT *rc)
     const unsigned int v01 = m_iData[idx01];
     const unsigned int v10 = m_iData[idx10];
     const unsigned int v11 = m_iData[idx11];
-    const double sum = (double)((v11 - v01) - (v10 - v00));
+    const unsigned int uSum = (v11 - v01) - (v10 - v00); 
+    const double sum = (double)uSum;
 
-    const I2TYPE s00 = m_llData[idx00]; 
-    const I2TYPE s01 = m_llData[idx01];
-    const I2TYPE s10 = m_llData[idx10];
-    const I2TYPE s11 = m_llData[idx11];
-    const double sum2 = (double)((s11 - s01) - (s10 - s00));
+    double sum2; 
+    if (m_bCompactNorm) 
+        sum2 = (double)ComputeSum2Compact(rc, uSum); 
+    else
+    {
+        const I2TYPE s00 = m_llData[idx00]; 
+        const I2TYPE s01 = m_llData[idx01];
+        const I2TYPE s10 = m_llData[idx10];
+        const I2TYPE s11 = m_llData[idx11];
+        sum2 = (double)((s11 - s01) - (s10 - s00));
+    }
 
     double area = rc->Area(); 
     double var = sqrt(sum2*area-sum*sum); 
@@ -38,6 +38,29 @@ namespace color_conv        // name space for color conversion
 
 class IMAGEC; 
 
+// IMAGE::ResampleToImage averages the covered pixels along an axis reduced at least this much, 
+// below that it interpolates bilinearly 
+#define RESAMPLE_AREA_MIN_RATIO     1.5f
+
+// pixel layouts of caller-owned buffers that can be turned into integral images directly 
+typedef enum
+{
+    PIXFMT_GRAY8 = 0,           // 8-bit luminance, also the Y plane of NV12/I420 
+    PIXFMT_RGB24,
+    PIXFMT_BGR24,
+    PIXFMT_BGRA32,
+    PIXFMT_RGBA32,
+    PIXFMT_YUV24,               // packed Y U V, the layout of IMAGEC::YUV 
+    PIXFMT_YUYV                 // packed 4:2:2 Y0 U Y1 V 
+} PIXEL_FORMAT; 
+
+// I_IMAGE::InitSkinMask() counts a pixel as skin when its U (Cb) and V (Cr) are inside this 
+// box, the chroma ranges of Chai and Ngan. skin tones differ mostly in Y, not in chroma 
+#define SKIN_U_MIN                  77
+#define SKIN_U_MAX                  127
+#define SKIN_V_MIN                  133
+#define SKIN_V_MAX                  173
+
 // image class, we only handle gray scale images here
 class IMAGE 
 {
@@ -98,6 +121,8 @@ public:
     void          HFlipToImage(IMAGE *pFImg, bool bVFlip=false); 
     void          ScaleToImage(IMAGE *pSImg, int scaleFactor, bool bVFlip=false); 
     void          CropToImage(IMAGE *pCImg, const IRECT *pRect, bool bVFlip=false); 
+    // resample the pSrcRect part (default the whole image) to any size, the ratio needs not be an integer 
+    void          ResampleToImage(IMAGE *pRImg, int width, int height, const IRECT *pSrcRect=NULL); 
 };
 
 /******************************************************************************\
@@ -145,6 +170,10 @@ public:
 
     void Init(const IMAGE* pImage);
     void InitWithSubSample(const IN_IMAGE* pIImage, int x, int y, float scale); 
+    // integral of the 0/1 skin mask of a color image, the number of skin pixels in a window 
+    // is then four lookups. PIXFMT_GRAY8 has no color and throws 
+    void InitSkinMask(const BYTE* pData, int width, int height, int stride, PIXEL_FORMAT format); 
+    void InitSkinMask(const IMAGEC* pImgC); 
     //void Init(const IMAGE* pImageA, const IMAGE* pImageB);
 
     unsigned int GetValue(int x, int y) const; 
@@ -163,11 +192,23 @@ public:
 *       Integral Image Class with normalization 
 *
 \******************************************************************************/
+// a window up to this area gets its sum of (v-128)^2 right from 32-bit compact norm data 
+#define COMPACT_NORM_MAX_AREA       (1<<18)
+
 class IN_IMAGE : public I_IMAGE    // normalized integral image 
 {
 protected: 
     I2TYPE *m_llData; 
 
+    // compact norm data: a 32-bit integral of (v-128)^2 replaces the 64-bit squared integral, 
+    // 8 instead of 12 bytes per pixel. The window sums wrap modulo 2^32 but are exact up to 
+    // COMPACT_NORM_MAX_AREA pixels, larger windows are summed in horizontal strips, so 
+    // ComputeNorm() returns exactly the same value in both modes 
+    bool          m_bCompactNorm; 
+    unsigned int *m_iData2; 
+
+    I2TYPE        ComputeSum2Compact(IRECT *rc, unsigned int sum); 
+
 public: 
     IN_IMAGE();
     //
@@ -182,7 +223,28 @@ public:
     void          Release(); 
 
     void Init(const IMAGE* pImage);
+    // build from a caller-owned buffer without making a gray copy, color is converted to luma on the fly 
+    void Init(const BYTE* pData, int width, int height, int stride, PIXEL_FORMAT format);
+#ifndef _NO_LIBJPEG
+    // decode a JPEG file one scanline at a time straight into the integral images, 
+    // the decoded frame is never held in memory. scaleDenom of 2, 4 or 8 lets libjpeg 
+    // downscale in the DCT domain, pixel (x,y) then covers (x*scaleDenom, y*scaleDenom) 
+    void LoadJPG(const char *fileName, int scaleDenom=1); 
+#endif
+    // load an image file, JPEGs are streamed, other formats go through IMAGE 
+    void Load(const char *fileName); 
+
+    // row-by-row construction for decoders that produce one scanline at a time: 
+    // BeginRows() sizes the image and clears the first row, then AccumulateRow() is 
+    // called for source rows 0, 1, ... height-1 in order 
+    void BeginRows(int width, int height); 
+    void AccumulateRow(int iY, const BYTE* pSrc, PIXEL_FORMAT format); 
+
+    // takes effect at the next Init(), the default is the full 64-bit squared integral 
+    void          SetCompactNorm(bool bCompact); 
+    bool          IsCompactNorm() const { return m_bCompactNorm; }; 
 
+    // not available with compact norm data 
     I2TYPE GetValue2(int x, int y) const; 
     inline I2TYPE * GetDataPtr2() const { return m_llData; }; 
 
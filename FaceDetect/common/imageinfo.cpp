@@ -57,11 +57,12 @@ void IMGINFO::ReadInfo(FILE *fp, const char *szPath)
     char szName[MAX_PATH]; 
     // sorry, I am not checking any file reading errors here 
     fgets(szName, MAX_PATH, fp);    // file name may contain spaces, so we have to read the whole line here 
-    int len = (int)strlen(szName); 
-    szName[len-1] = '\0';           // remove the new line character 
-    len = (int)(strlen(szPath) + strlen(szName) + 2); 
+    int len = (int)strlen(szName);
+    while (len > 0 && (szName[len-1] == '\n' || szName[len-1] == '\r'))
+        szName[--len] = '\0';       // remove the new line character (label files may have DOS line ends)
+    len =(int)(strlen(szPath) + strlen(szName) + 2); 
     m_szFileName = new char [len]; 
-    sprintf(m_szFileName, "%s\\%s", szPath, szName); 
+    sprintf(m_szFileName, "%s" PATH_SEPARATOR_STR "%s", szPath, szName); 
 
     /* // code to read old file
     fscanf(fp, "%d\n", &m_nNumObj); 
@@ -0,0 +1,282 @@
+/******************************************************************************\
+*
+*   Member functions for the IMAGELOADER class
+*
+\******************************************************************************/
+
+#include "stdafx.h"
+#include "imgloader.h"
+#include "threadpool.h"
+
+IMAGELOADER::IMAGELOADER(const char * const *pszFileNames, int numFiles, int flags,
+                         int queueSize, int numThreads) :
+    m_pszFileNames(pszFileNames),
+    m_nNumFiles(numFiles),
+    m_nFlags(flags),
+    m_nQueueSize(max(queueSize, 2)),
+    m_nNextLoad(0),
+    m_nNextOut(0),
+    m_bQuit(false)
+{
+    if (!(m_nFlags & (LOADER_IMAGE | LOADER_IIMAGE)))
+        throw "Nothing to load";
+
+    if (numThreads <= 0)
+        numThreads = min(THREADPOOL::GetNumProcessors(), m_nQueueSize-1);
+    m_nNumThreads = max(min(numThreads, m_nNumFiles), 1);
+
+    m_pSlots = new SLOT [m_nQueueSize];
+    for (int i=0; i<m_nQueueSize; i++)
+    {
+        m_pSlots[i].m_nIndex = -1;
+        m_pSlots[i].m_bReady = false;
+        m_pSlots[i].m_bFailed = false;
+        m_pSlots[i].m_szError[0] = '\0';
+        m_pSlots[i].m_IImage.SetCompactNorm(true); 
+    }
+    m_pWorkers = new WORKER [m_nNumThreads];
+    for (int i=0; i<m_nNumThreads; i++)
+        m_pWorkers[i].m_pLoader = this;
+
+    InitThreadLock(&m_Lock);
+#if defined(_WIN32)
+    m_hSlotSem = CreateSemaphore(NULL, 0, MAXLONG, NULL);
+    m_hReadyEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (m_hSlotSem == NULL || m_hReadyEvent == NULL)
+    {
+        if (m_hSlotSem) CloseHandle(m_hSlotSem);
+        if (m_hReadyEvent) CloseHandle(m_hReadyEvent);
+        DeleteThreadLock(&m_Lock);
+        delete []m_pWorkers;
+        delete []m_pSlots;
+        throw "Image loader creation failed";
+    }
+
+    m_phThreads = new HANDLE [m_nNumThreads];
+    for (int i=0; i<m_nNumThreads; i++)
+    {
+        DWORD dwThreadId;
+        m_phThreads[i] = CreateThread(NULL, 0, LoaderThreadProc, &m_pWorkers[i], 0, &dwThreadId);
+        if (m_phThreads[i] == NULL)
+        {
+            // the threads already running are stopped and joined, no destructor will run
+            m_nNumThreads = i;
+            Shutdown();
+            throw "Thread creation failed";
+        }
+    }
+#else
+    pthread_cond_init(&m_SlotCond, NULL);
+    pthread_cond_init(&m_ReadyCond, NULL);
+
+    m_pThreads = new pthread_t [m_nNumThreads];
+    for (int i=0; i<m_nNumThreads; i++)
+    {
+        if (pthread_create(&m_pThreads[i], NULL, LoaderThreadProc, &m_pWorkers[i]) != 0)
+        {
+            m_nNumThreads = i;
+            Shutdown();
+            throw "Thread creation failed";
+        }
+    }
+#endif
+}
+
+IMAGELOADER::~IMAGELOADER()
+{
+    Shutdown();
+}
+
+// stop and join the m_nNumThreads threads running and free everything
+void IMAGELOADER::Shutdown()
+{
+    // threads in the middle of a load finish it first
+    Lock();
+    m_bQuit = true;
+    Unlock();
+
+#if defined(_WIN32)
+    ReleaseSemaphore(m_hSlotSem, max(m_nNumThreads, 1), NULL);
+    // one wait takes at most MAXIMUM_WAIT_OBJECTS handles
+    for (int i=0; i<m_nNumThreads; i+=MAXIMUM_WAIT_OBJECTS)
+        WaitForMultipleObjects(min(m_nNumThreads-i, MAXIMUM_WAIT_OBJECTS), m_phThreads+i, TRUE, INFINITE);
+    for (int i=0; i<m_nNumThreads; i++)
+        CloseHandle(m_phThreads[i]);
+    delete []m_phThreads;
+    CloseHandle(m_hSlotSem);
+    CloseHandle(m_hReadyEvent);
+#else
+    pthread_cond_broadcast(&m_SlotCond);
+    for (int i=0; i<m_nNumThreads; i++)
+        pthread_join(m_pThreads[i], NULL);
+    delete []m_pThreads;
+    pthread_cond_destroy(&m_SlotCond);
+    pthread_cond_destroy(&m_ReadyCond);
+#endif
+    DeleteThreadLock(&m_Lock);
+
+    delete []m_pWorkers;
+    delete []m_pSlots;
+}
+
+void IMAGELOADER::Lock()
+{
+    EnterThreadLock(&m_Lock);
+}
+
+void IMAGELOADER::Unlock()
+{
+    LeaveThreadLock(&m_Lock);
+}
+
+int IMAGELOADER::Next()
+{
+    Lock();
+    if (m_nNextOut >= m_nNumFiles)
+    {
+        m_nNextOut = m_nNumFiles + 1;   // GetImage() returns NULL from now on
+        Unlock();
+        return -1;
+    }
+
+    // the slot handed out last time is free again
+    int index = m_nNextOut ++;
+    if (index > 0)
+    {
+#if defined(_WIN32)
+        ReleaseSemaphore(m_hSlotSem, 1, NULL);
+#else
+        pthread_cond_signal(&m_SlotCond);
+#endif
+    }
+
+    SLOT *pSlot = &m_pSlots[index % m_nQueueSize];
+    while (pSlot->m_nIndex != index || !pSlot->m_bReady)
+    {
+#if defined(_WIN32)
+        Unlock();
+        WaitForSingleObject(m_hReadyEvent, INFINITE);
+        Lock();
+#else
+        pthread_cond_wait(&m_ReadyCond, &m_Lock);
+#endif
+    }
+    Unlock();
+
+    if (pSlot->m_bFailed)
+        throw (const char *)pSlot->m_szError;
+    return index;
+}
+
+IMAGE * IMAGELOADER::GetImage()
+{
+    if (!(m_nFlags & LOADER_IMAGE) || m_nNextOut <= 0 || m_nNextOut > m_nNumFiles)
+        return NULL;
+    return &m_pSlots[(m_nNextOut-1) % m_nQueueSize].m_Image;
+}
+
+IN_IMAGE * IMAGELOADER::GetIImage()
+{
+    if (!(m_nFlags & LOADER_IIMAGE) || m_nNextOut <= 0 || m_nNextOut > m_nNumFiles)
+        return NULL;
+    return &m_pSlots[(m_nNextOut-1) % m_nQueueSize].m_IImage;
+}
+
+void IMAGELOADER::LoadOne(WORKER *pWorker, SLOT *pSlot)
+{
+    const char *szFileName = m_pszFileNames[pSlot->m_nIndex];
+    IMAGE *pImage = (m_nFlags & LOADER_IMAGE) ? &pSlot->m_Image : &pWorker->m_Image;
+
+#ifndef _NO_LIBJPEG
+    const char *ext = strrchr(szFileName, '.');
+    if (ext != NULL && _stricmp(ext+1, "jpg") == 0)
+    {
+        if (m_nFlags & LOADER_IMAGE)
+        {
+            pWorker->m_Decoder.DecodeFile(szFileName, pImage);
+            if (m_nFlags & LOADER_IIMAGE)
+                pSlot->m_IImage.Init(pImage);
+        }
+        else
+            pWorker->m_Decoder.DecodeFile(szFileName, &pSlot->m_IImage);
+        return;
+    }
+#endif
+
+    pImage->Load(szFileName);
+    if (m_nFlags & LOADER_IIMAGE)
+        pSlot->m_IImage.Init(pImage);
+}
+
+void IMAGELOADER::LoaderLoop(WORKER *pWorker)
+{
+    for (;;)
+    {
+        // a slot is free when the consumer is done with the image that was in it
+        Lock();
+        while (!m_bQuit && m_nNextLoad < m_nNumFiles &&
+               m_nNextLoad >= m_nNextOut + m_nQueueSize - (m_nNextOut > 0 ? 1 : 0))
+        {
+#if defined(_WIN32)
+            // a stale semaphore count only causes one extra trip around this loop
+            Unlock();
+            WaitForSingleObject(m_hSlotSem, INFINITE);
+            Lock();
+#else
+            pthread_cond_wait(&m_SlotCond, &m_Lock);
+#endif
+        }
+        if (m_bQuit || m_nNextLoad >= m_nNumFiles)
+        {
+            Unlock();
+            break;
+        }
+        int index = m_nNextLoad ++;
+        SLOT *pSlot = &m_pSlots[index % m_nQueueSize];
+        pSlot->m_nIndex = index;
+        pSlot->m_bReady = false;
+        Unlock();
+
+        pSlot->m_bFailed = false;
+        try
+        {
+            LoadOne(pWorker, pSlot);
+        }
+        catch (const char *szMsg)
+        {
+            pSlot->m_bFailed = true;
+            strncpy(pSlot->m_szError, szMsg, sizeof(pSlot->m_szError)-1);
+            pSlot->m_szError[sizeof(pSlot->m_szError)-1] = '\0';
+        }
+        catch (...)
+        {
+            pSlot->m_bFailed = true;
+            strcpy(pSlot->m_szError, "Out of memory");
+        }
+
+        Lock();
+        pSlot->m_bReady = true;
+#if defined(_WIN32)
+        SetEvent(m_hReadyEvent);
+#else
+        pthread_cond_signal(&m_ReadyCond);
+#endif
+        Unlock();
+    }
+}
+
+#if defined(_WIN32)
+DWORD WINAPI IMAGELOADER::LoaderThreadProc(LPVOID lpParam)
+{
+    WORKER *pWorker = (WORKER *)lpParam;
+    pWorker->m_pLoader->LoaderLoop(pWorker);
+    return 0;
+}
+#else
+void * IMAGELOADER::LoaderThreadProc(void *lpParam)
+{
+    WORKER *pWorker = (WORKER *)lpParam;
+    pWorker->m_pLoader->LoaderLoop(pWorker);
+    return NULL;
+}
+#endif
@@ -0,0 +1,113 @@
+#pragma once
+
+/******************************************************************************\
+*
+*   IMAGELOADER
+*
+*       Loads the images of a file list ahead of the consumer. Background
+*       threads read and decode the next images into a ring of queueSize slots
+*       while the caller works on the current one, so disk (or network) reads
+*       and JPEG decoding overlap with detection. Images are always handed out
+*       in list order, whatever order the loads finish in.
+*
+*       JPEG files are read into memory in one go and decoded with a per-thread
+*       JPEGDECODER; any other format goes through IMAGE::Load.
+*
+*       Typical use:
+*
+*           IMAGELOADER loader(pszFileNames, numFiles, LOADER_IIMAGE);
+*           for (int i=0; i<numFiles; i++)
+*           {
+*               loader.Next();
+*               detector.DetectObject(loader.GetIImage());
+*           }
+*
+*       The slots are reused, a pointer returned by GetImage()/GetIImage() is
+*       only valid until the next call to Next(). Each slot keeps an IN_IMAGE
+*       (with compact norm data) of the largest image it has held, about 9
+*       bytes per pixel, so keep queueSize small when LOADER_IIMAGE is used on
+*       large photos.
+*
+\******************************************************************************/
+
+#include "image.h"
+#include "jpegdec.h"
+#include "threadpool.h"
+
+// what each slot is filled with, may be combined
+#define LOADER_IMAGE            1       // the gray image
+#define LOADER_IIMAGE           2       // the integral images
+
+class IMAGELOADER
+{
+    struct SLOT
+    {
+        int             m_nIndex;       // index in the file list of the image held
+        bool            m_bReady;       // loading is finished, successfully or not
+        bool            m_bFailed;
+        char            m_szError[256];
+        IMAGE           m_Image;
+        IN_IMAGE        m_IImage;
+    };
+
+    // state owned by one loading thread
+    struct WORKER
+    {
+        IMAGELOADER   * m_pLoader;
+        IMAGE           m_Image;        // scratch image for formats other than JPEG
+#ifndef _NO_LIBJPEG
+        JPEGDECODER     m_Decoder;
+#endif
+    };
+
+    const char * const * m_pszFileNames;
+    int             m_nNumFiles;
+    int             m_nFlags;
+
+    int             m_nQueueSize;
+    SLOT          * m_pSlots;
+    int             m_nNumThreads;
+    WORKER        * m_pWorkers;
+
+    // protected by m_Lock
+    int             m_nNextLoad;        // next file to be claimed by a loading thread
+    int             m_nNextOut;         // file handed out by the next call to Next()
+    bool            m_bQuit;
+
+#if defined(_WIN32)
+    HANDLE        * m_phThreads;
+    HANDLE          m_hSlotSem;         // released every time the consumer frees a slot
+    HANDLE          m_hReadyEvent;      // set every time a slot finishes loading
+#else
+    pthread_t     * m_pThreads;
+    pthread_cond_t  m_SlotCond;
+    pthread_cond_t  m_ReadyCond;
+#endif
+    THREADLOCK      m_Lock;
+
+    void            Lock();
+    void            Unlock();
+    void            Shutdown();
+    void            LoaderLoop(WORKER *pWorker);
+    void            LoadOne(WORKER *pWorker, SLOT *pSlot);
+
+#if defined(_WIN32)
+    static DWORD WINAPI LoaderThreadProc(LPVOID lpParam);
+#else
+    static void *   LoaderThreadProc(void *lpParam);
+#endif
+
+public:
+    // pszFileNames must stay valid for the lifetime of the loader.
+    // numThreads 0 picks one per processor, capped at queueSize-1
+    IMAGELOADER(const char * const *pszFileNames, int numFiles, int flags = LOADER_IMAGE,
+                int queueSize = 8, int numThreads = 0);
+    ~IMAGELOADER();
+
+    // wait for the next image in list order, return its index or -1 past the end of the list.
+    // throws the load error of that image, the loader itself can still be used afterwards
+    int             Next();
+
+    IMAGE         * GetImage();
+    IN_IMAGE      * GetIImage();
+};
@@ -0,0 +1,319 @@
+/******************************************************************************\
+*
+*   Member functions for the JPEGDECODER class
+*
+\******************************************************************************/
+
+#include "stdafx.h"
+#include "jpegdec.h"
+#include "fileio.h"
+
+#ifndef _NO_LIBJPEG
+
+/******************************************************************************\
+*
+*   memory source manager
+*
+*   The whole compressed image is handed to libjpeg as one buffer. Running out
+*   of data means the image is truncated, in which case a fake EOI marker is
+*   supplied so that whatever is there is still decoded (same as jdatasrc.c).
+*
+\******************************************************************************/
+
+static const JOCTET s_FakeEOI[2] = { (JOCTET)0xFF, (JOCTET)JPEG_EOI };
+
+void JPEGDECODER::InitSource(j_decompress_ptr)
+{
+}
+
+boolean JPEGDECODER::FillInputBuffer(j_decompress_ptr cinfo)
+{
+    WARNMS(cinfo, JWRN_JPEG_EOF);
+    cinfo->src->next_input_byte = s_FakeEOI;
+    cinfo->src->bytes_in_buffer = 2;
+    return TRUE;
+}
+
+void JPEGDECODER::SkipInputData(j_decompress_ptr cinfo, long numBytes)
+{
+    if (numBytes <= 0)
+        return;
+    if ((size_t)numBytes > cinfo->src->bytes_in_buffer)
+        FillInputBuffer(cinfo);
+    else
+    {
+        cinfo->src->next_input_byte += (size_t)numBytes;
+        cinfo->src->bytes_in_buffer -= (size_t)numBytes;
+    }
+}
+
+void JPEGDECODER::TermSource(j_decompress_ptr)
+{
+}
+
+// unlike the default handler in jerror.cpp, the decompressor is kept alive for the next image
+void JPEGDECODER::ErrorExit(j_common_ptr cinfo)
+{
+    ERROR_MGR *pErr = (ERROR_MGR *)cinfo->err;
+    (*cinfo->err->format_message)(cinfo, pErr->szMsg);
+    longjmp(pErr->jmpBuf, 1);
+}
+
+/******************************************************************************\
+*
+*   EXIF thumbnail
+*
+*   The APP1 segment holds a TIFF structure: IFD0 describes the main image,
+*   the optional IFD1 the thumbnail. A JPEG thumbnail is stored as a byte
+*   range given by the JPEGInterchangeFormat (0x0201) and
+*   JPEGInterchangeFormatLength (0x0202) tags of IFD1.
+*
+\******************************************************************************/
+
+static unsigned int ReadTiff16(const BYTE *p, bool bBigEndian)
+{
+    return bBigEndian ? ((p[0] << 8) | p[1]) : ((p[1] << 8) | p[0]);
+}
+
+static unsigned int ReadTiff32(const BYTE *p, bool bBigEndian)
+{
+    // p[i] promotes to a signed int, shifting a byte >= 0x80 into its sign bit would overflow
+    return bBigEndian ? (((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3])
+                      : (((unsigned int)p[3] << 24) | ((unsigned int)p[2] << 16) | ((unsigned int)p[1] << 8) | p[0]);
+}
+
+static bool FindTiffThumbnail(const BYTE *pTiff, size_t size, const BYTE **ppThumb, size_t *pThumbSize)
+{
+    if (size < 8)
+        return false;
+    bool bBigEndian;
+    if (pTiff[0] == 'I' && pTiff[1] == 'I')
+        bBigEndian = false;
+    else if (pTiff[0] == 'M' && pTiff[1] == 'M')
+        bBigEndian = true;
+    else
+        return false;
+    if (ReadTiff16(pTiff+2, bBigEndian) != 42)
+        return false;
+
+    // skip IFD0 to get to IFD1
+    size_t ifd = ReadTiff32(pTiff+4, bBigEndian);
+    if (ifd > size-2)
+        return false;
+    size_t numEntries = ReadTiff16(pTiff+ifd, bBigEndian);
+    if (ifd+2+numEntries*12+4 > size)
+        return false;
+    ifd = ReadTiff32(pTiff+ifd+2+numEntries*12, bBigEndian);
+    if (ifd == 0 || ifd > size-2)
+        return false;
+    numEntries = ReadTiff16(pTiff+ifd, bBigEndian);
+    if (ifd+2+numEntries*12 > size)
+        return false;
+
+    size_t offset = 0, length = 0;
+    for (size_t i=0; i<numEntries; i++)
+    {
+        const BYTE *pEntry = pTiff + ifd + 2 + i*12;
+        unsigned int tag = ReadTiff16(pEntry, bBigEndian);
+        unsigned int type = ReadTiff16(pEntry+2, bBigEndian);
+        unsigned int value = (type == 3) ? ReadTiff16(pEntry+8, bBigEndian)     // SHORT
+                                         : ReadTiff32(pEntry+8, bBigEndian);    // LONG
+        if (tag == 0x0103 && value != 6)    // compression other than JPEG
+            return false;
+        if (tag == 0x0201)
+            offset = value;
+        else if (tag == 0x0202)
+            length = value;
+    }
+    if (offset == 0 || length < 4 || offset > size || length > size-offset)
+        return false;
+    if (pTiff[offset] != 0xFF || pTiff[offset+1] != 0xD8)        // SOI
+        return false;
+
+    *ppThumb = pTiff + offset;
+    *pThumbSize = length;
+    return true;
+}
+
+bool JPEGDECODER::FindExifThumbnail(const BYTE *pData, size_t size, const BYTE **ppThumb, size_t *pThumbSize)
+{
+    if (size < 4 || pData[0] != 0xFF || pData[1] != 0xD8)        // SOI
+        return false;
+
+    // walk the marker segments in front of the first scan
+    size_t pos = 2;
+    while (pos+4 <= size)
+    {
+        if (pData[pos] != 0xFF)
+            return false;
+        int marker = pData[pos+1];
+        if (marker == 0xFF)         // fill byte
+        {
+            pos ++;
+            continue;
+        }
+        if (marker == JPEG_EOI || marker == 0xDA)   // end of image or start of scan
+            return false;
+        size_t length = (pData[pos+2] << 8) | pData[pos+3];
+        if (length < 2 || length > size-pos-2)
+            return false;
+        if (marker == JPEG_APP0+1 && length >= 8 && memcmp(pData+pos+4, "Exif\0\0", 6) == 0)
+            return FindTiffThumbnail(pData+pos+10, length-8, ppThumb, pThumbSize);
+        pos += 2 + length;
+    }
+    return false;
+}
+
+JPEGDECODER::JPEGDECODER() :
+    m_pRowBuf(NULL),
+    m_nRowBufSize(0),
+    m_pFileBuf(NULL),
+    m_nFileBufSize(0)
+{
+    m_cinfo.err = jpeg_std_error(&m_Err.pub);
+    m_Err.pub.error_exit = ErrorExit;
+    m_Err.szMsg[0] = '\0';
+    jpeg_create_decompress(&m_cinfo);
+
+    m_Src.init_source = InitSource;
+    m_Src.fill_input_buffer = FillInputBuffer;
+    m_Src.skip_input_data = SkipInputData;
+    m_Src.resync_to_restart = jpeg_resync_to_restart;   // use default method
+    m_Src.term_source = TermSource;
+    m_Src.next_input_byte = NULL;
+    m_Src.bytes_in_buffer = 0;
+    m_cinfo.src = &m_Src;
+}
+
+JPEGDECODER::~JPEGDECODER()
+{
+    jpeg_destroy_decompress(&m_cinfo);
+    if (m_pRowBuf) { delete []m_pRowBuf; m_pRowBuf = NULL; }
+    if (m_pFileBuf) { delete []m_pFileBuf; m_pFileBuf = NULL; }
+}
+
+BYTE * JPEGDECODER::GetRowBuf(int width)
+{
+    if (m_nRowBufSize < width)
+    {
+        if (m_pRowBuf) delete []m_pRowBuf;
+        m_pRowBuf = new BYTE [width];
+        if (!m_pRowBuf)
+            throw "Out of memory";
+        m_nRowBufSize = width;
+    }
+    return m_pRowBuf;
+}
+
+// read szFileName into m_pFileBuf, return its size
+size_t JPEGDECODER::ReadFile(const char *szFileName)
+{
+    size_t size;
+    if (!GetBinaryFileSize(szFileName, &size) || size == 0)
+        throw "Open file failed";
+    if (m_nFileBufSize < size)
+    {
+        if (m_pFileBuf) delete []m_pFileBuf;
+        m_pFileBuf = NULL;
+        m_nFileBufSize = 0;
+        m_pFileBuf = new BYTE [size];
+        m_nFileBufSize = size;
+    }
+    if (!ReadBinaryFile(szFileName, m_pFileBuf, size))
+        throw "Read file failed";
+    return size;
+}
+
+// must be called right after setjmp(m_Err.jmpBuf)
+void JPEGDECODER::Start(const BYTE *pData, size_t size, int scaleDenom)
+{
+    if (scaleDenom != 1 && scaleDenom != 2 && scaleDenom != 4 && scaleDenom != 8)
+        throw "Unsupported JPEG scale";
+
+    jpeg_abort_decompress(&m_cinfo);    // in case the previous image was left half done
+    m_Src.next_input_byte = (const JOCTET *)pData;
+    m_Src.bytes_in_buffer = size;
+    jpeg_read_header(&m_cinfo, TRUE);
+
+    // force the output format to be grayscale, same as IMAGE::LoadJPG
+    m_cinfo.out_color_space = JCS_GRAYSCALE;
+    m_cinfo.scale_num = 1;
+    m_cinfo.scale_denom = scaleDenom;
+    jpeg_start_decompress(&m_cinfo);
+}
+
+bool JPEGDECODER::GetSize(const BYTE *pData, size_t size, int *pWidth, int *pHeight)
+{
+    if (setjmp(m_Err.jmpBuf))
+    {
+        jpeg_abort_decompress(&m_cinfo);
+        return false;
+    }
+    jpeg_abort_decompress(&m_cinfo);
+    m_Src.next_input_byte = (const JOCTET *)pData;
+    m_Src.bytes_in_buffer = size;
+    jpeg_read_header(&m_cinfo, TRUE);
+    *pWidth = (int)m_cinfo.image_width;
+    *pHeight = (int)m_cinfo.image_height;
+    jpeg_abort_decompress(&m_cinfo);
+    return true;
+}
+
+void JPEGDECODER::Decode(const BYTE *pData, size_t size, IMAGE *pImage, int scaleDenom)
+{
+    if (setjmp(m_Err.jmpBuf))
+    {
+        jpeg_abort_decompress(&m_cinfo);
+        throw (const char *)m_Err.szMsg;
+    }
+    Start(pData, size, scaleDenom);
+
+    int width = (int)m_cinfo.output_width;
+    int height = (int)m_cinfo.output_height;
+    if (pImage->GetWidth() != width || pImage->GetHeight() != height)
+        pImage->Realloc(width, height);
+
+    JSAMPROW row = pImage->GetDataPtr();
+    while (m_cinfo.output_scanline < m_cinfo.output_height)
+    {
+        jpeg_read_scanlines(&m_cinfo, &row, 1);
+        row += pImage->GetStride();
+    }
+    jpeg_finish_decompress(&m_cinfo);
+}
+
+void JPEGDECODER::Decode(const BYTE *pData, size_t size, IN_IMAGE *pIImage, int scaleDenom)
+{
+    if (setjmp(m_Err.jmpBuf))
+    {
+        jpeg_abort_decompress(&m_cinfo);
+        throw (const char *)m_Err.szMsg;
+    }
+    Start(pData, size, scaleDenom);
+
+    int width = (int)m_cinfo.output_width;
+    pIImage->BeginRows(width, (int)m_cinfo.output_height);
+
+    JSAMPROW row = GetRowBuf(width);
+    while (m_cinfo.output_scanline < m_cinfo.output_height)
+    {
+        int iY = (int)m_cinfo.output_scanline;
+        jpeg_read_scanlines(&m_cinfo, &row, 1);
+        pIImage->AccumulateRow(iY, row, PIXFMT_GRAY8);
+    }
+    jpeg_finish_decompress(&m_cinfo);
+}
+
+void JPEGDECODER::DecodeFile(const char *szFileName, IMAGE *pImage, int scaleDenom)
+{
+    size_t size = ReadFile(szFileName);
+    Decode(m_pFileBuf, size, pImage, scaleDenom);
+}
+
+void JPEGDECODER::DecodeFile(const char *szFileName, IN_IMAGE *pIImage, int scaleDenom)
+{
+    size_t size = ReadFile(szFileName);
+    Decode(m_pFileBuf, size, pIImage, scaleDenom);
+}
+
+#endif  // _NO_LIBJPEG
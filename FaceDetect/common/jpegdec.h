@@ -0,0 +1,78 @@
+#pragma once
+
+/******************************************************************************\
+*
+*   JPEGDECODER
+*
+*       Decodes JPEG images held in memory. The libjpeg decompressor, the
+*       source manager and the scanline buffer are created once and kept
+*       between images, so a decoder owned by a worker thread pays the setup
+*       cost only on its first image. A decoder is not thread safe, use one per
+*       thread.
+*
+*       Output is always 8-bit gray, the same as IMAGE::LoadJPG.
+*
+\******************************************************************************/
+
+#ifndef _NO_LIBJPEG
+
+#include <setjmp.h>
+#include "image.h"
+
+extern "C" {
+#include "jpeglib.h"
+#include "jerror.h"
+}
+
+class JPEGDECODER
+{
+    // error manager that returns control to the decoder instead of exiting
+    struct ERROR_MGR
+    {
+        struct jpeg_error_mgr   pub;
+        jmp_buf                 jmpBuf;
+        char                    szMsg[JMSG_LENGTH_MAX];
+    };
+
+    struct jpeg_decompress_struct   m_cinfo;
+    ERROR_MGR                       m_Err;
+    struct jpeg_source_mgr          m_Src;
+
+    BYTE          * m_pRowBuf;          // one scanline, grows to the widest image seen
+    int             m_nRowBufSize;
+    BYTE          * m_pFileBuf;         // compressed file, grows to the largest seen
+    size_t          m_nFileBufSize;
+
+    static void     ErrorExit(j_common_ptr cinfo);
+    static void     InitSource(j_decompress_ptr cinfo);
+    static boolean  FillInputBuffer(j_decompress_ptr cinfo);
+    static void     SkipInputData(j_decompress_ptr cinfo, long numBytes);
+    static void     TermSource(j_decompress_ptr cinfo);
+
+    void            Start(const BYTE *pData, size_t size, int scaleDenom);
+    BYTE          * GetRowBuf(int width);
+    size_t          ReadFile(const char *szFileName);
+
+public:
+    JPEGDECODER();
+    ~JPEGDECODER();
+
+    // read only the header, returns false if the data is not a JPEG image
+    bool            GetSize(const BYTE *pData, size_t size, int *pWidth, int *pHeight);
+
+    // locate the JPEG thumbnail in the EXIF block (IFD1) without decoding anything.
+    // *ppThumb points into pData, returns false if there is no usable thumbnail
+    static bool     FindExifThumbnail(const BYTE *pData, size_t size, const BYTE **ppThumb, size_t *pThumbSize);
+
+    // decode into a gray image. scaleDenom of 2, 4 or 8 downscales in the DCT domain
+    void            Decode(const BYTE *pData, size_t size, IMAGE *pImage, int scaleDenom=1);
+
+    // decode scanline by scanline straight into the integral images
+    void            Decode(const BYTE *pData, size_t size, IN_IMAGE *pIImage, int scaleDenom=1);
+
+    // read the whole file in one sequential pass, then decode it as above
+    void            DecodeFile(const char *szFileName, IMAGE *pImage, int scaleDenom=1);
+    void            DecodeFile(const char *szFileName, IN_IMAGE *pIImage, int scaleDenom=1);
+};
+
+#endif  // _NO_LIBJPEG
@@ -0,0 +1,179 @@
+/******************************************************************************\
+*
+*   Member functions for the MULTIDETECTOR class
+*
+\******************************************************************************/
+
+#include "stdafx.h"
+#include "multidetector.h"
+
+MULTIDETECTOR::MULTIDETECTOR() :
+    m_nNumModels(0),
+    m_nSharedStages(0),
+    m_nTotalWindows(0)
+{
+    for (int i=0; i<MAX_NUM_MODELS; i++) 
+        m_pModels[i] = NULL; 
+}
+
+// two classifiers that always give the same score and prune decision 
+bool MULTIDETECTOR::SameClassifier(CLASSIFIER *pC1, CLASSIFIER *pC2)
+{
+    if (pC1->m_nNumTh != pC2->m_nNumTh || 
+        pC1->GetMinPosScoreTh() != pC2->GetMinPosScoreTh() || 
+        pC1->m_Feature.m_nType != pC2->m_Feature.m_nType) 
+        return false; 
+    for (int i=0; i<pC1->m_nNumTh; i++) 
+        if (pC1->GetFeatureTh()[i] != pC2->GetFeatureTh()[i]) 
+            return false; 
+    for (int i=0; i<=pC1->m_nNumTh; i++) 
+        if (pC1->GetDScore()[i] != pC2->GetDScore()[i]) 
+            return false; 
+
+    if (pC1->m_Feature.m_nType != FEATURE::RECTFEATURE) 
+        return true; 
+    RCFEATURE *pF1 = pC1->m_Feature.m_pF.pRCF; 
+    RCFEATURE *pF2 = pC2->m_Feature.m_pF.pRCF; 
+    if (pF1->m_nRects != pF2->m_nRects) 
+        return false; 
+    for (int i=0; i<pF1->m_nRects; i++) 
+    {
+        const WEIGHTED_RECT &r1 = pF1->m_wRectArray[i]; 
+        const WEIGHTED_RECT &r2 = pF2->m_wRectArray[i]; 
+        if (r1.m_weight != r2.m_weight || 
+            r1.m_rect.m_ixMin != r2.m_rect.m_ixMin || r1.m_rect.m_ixMax != r2.m_rect.m_ixMax || 
+            r1.m_rect.m_iyMin != r2.m_rect.m_iyMin || r1.m_rect.m_iyMax != r2.m_rect.m_iyMax) 
+            return false; 
+    }
+    return true; 
+}
+
+int MULTIDETECTOR::AddModel(DETECTOR *pDetector)
+{
+    if (pDetector == NULL || !pDetector->IsValid()) 
+        throw "Invalid detector"; 
+    if (m_nNumModels >= MAX_NUM_MODELS) 
+        throw "Too many models"; 
+
+    DETECTOR *pFirst = m_nNumModels > 0 ? m_pModels[0] : pDetector; 
+    for (int s=0; s<MAX_NUM_SCALE; s++) 
+    {
+        if (pDetector->m_nWidth[s] != pFirst->m_nWidth[s] || pDetector->m_nHeight[s] != pFirst->m_nHeight[s] || 
+            pDetector->m_nStepW[s] != pFirst->m_nStepW[s] || pDetector->m_nStepH[s] != pFirst->m_nStepH[s]) 
+            throw "Models scan different windows"; 
+    }
+
+    // the shared stages can only shrink as models are added 
+    int shared = m_nNumModels > 0 ? m_nSharedStages : pDetector->m_nClassifiers; 
+    shared = min(shared, pDetector->m_nClassifiers); 
+    for (int s=0; s<MAX_NUM_SCALE && shared > 0; s++) 
+    {
+        int i = 0; 
+        while (i < shared && SameClassifier(&pFirst->m_ClassifierArray[s][i], &pDetector->m_ClassifierArray[s][i]))
+            i ++; 
+        shared = i; 
+    }
+
+    m_pModels[m_nNumModels] = pDetector; 
+    m_nSharedStages = shared; 
+    return m_nNumModels ++; 
+}
+
+void MULTIDETECTOR::DetectObject(IN_IMAGE *pIImg, int minScale, int maxScale)
+{
+    if (m_nNumModels == 0) 
+        throw "No model"; 
+    if (minScale < 0 || maxScale >= MAX_NUM_SCALE || minScale > maxScale)
+        throw "scale out of range"; 
+
+    DETECTOR *pFirst = m_pModels[0]; 
+    int shared = m_nSharedStages; 
+    bool bFull[MAX_NUM_MODELS]; 
+    for (int m=0; m<m_nNumModels; m++) 
+    {
+        DETWORKSPACE *pWS = &m_Workspaces[m]; 
+        pWS->Reserve(m_pModels[m]->m_nMaxNumRawDetRect); 
+        pWS->m_pIImg = pIImg; 
+        pWS->m_nNumRawDetRect = 0; 
+        pWS->m_nTotalWindows = 0; 
+        pWS->ResetPruneCount(m_pModels[m]->m_nClassifiers); 
+        bFull[m] = false; 
+        // the shared classifiers are run with the first model's pruning setting 
+        if (m_pModels[m]->m_bRejAtNodes != pFirst->m_bRejAtNodes) 
+            shared = 0; 
+    }
+
+    int width = pIImg->GetWidth(); 
+    int height = pIImg->GetHeight(); 
+    int numFull = 0; 
+    int totalWindows = 0; 
+    for (int nScale = minScale; nScale <= maxScale && numFull < m_nNumModels; nScale++) 
+    {
+        int winW = pFirst->m_nWidth[nScale]; 
+        int winH = pFirst->m_nHeight[nScale]; 
+        int stepW = pFirst->m_nStepW[nScale]; 
+        int stepH = pFirst->m_nStepH[nScale]; 
+        for (int y=0; y+winH <= height && numFull < m_nNumModels; y+=stepH) 
+        {
+            for (int x=0; x+winW <= width && numFull < m_nNumModels; x+=stepW) 
+            {
+                IRECT rect; 
+                rect.Reset(x, y, winW, winH); 
+                totalWindows ++; 
+
+                float norm = pIImg->ComputeNorm(&rect); 
+                float sharedScore = 0.0f; 
+                int rejected = pFirst->EvalStages(pIImg, &rect, nScale, norm, 0, shared, &sharedScore); 
+                if (rejected < shared) 
+                {
+#if defined(COUNT_PRUNE_EFFECT)
+                    for (int m=0; m<m_nNumModels; m++) 
+                        m_Workspaces[m].m_pnPruneCount[rejected] += 1; 
+#endif
+                    continue; 
+                }
+
+                for (int m=0; m<m_nNumModels; m++) 
+                {
+                    if (bFull[m]) 
+                        continue; 
+                    DETECTOR *pModel = m_pModels[m]; 
+                    float score = sharedScore; 
+                    int i = pModel->EvalStages(pIImg, &rect, nScale, norm, shared, pModel->m_nClassifiers, &score); 
+#if defined(COUNT_PRUNE_EFFECT)
+                    m_Workspaces[m].m_pnPruneCount[min(i, pModel->m_nClassifiers-1)] += 1; 
+#endif
+                    if (i < pModel->m_nClassifiers || score <= pModel->m_fFinalScoreTh) 
+                        continue; 
+
+                    DETWORKSPACE *pWS = &m_Workspaces[m]; 
+                    SCORED_RECT &det = pWS->m_pRawDetRect[pWS->m_nNumRawDetRect++]; 
+                    det.m_rect.Reset(x, y, winW, winH); 
+                    det.m_score = score; 
+                    if (pWS->m_nNumRawDetRect >= pModel->m_nMaxNumRawDetRect) 
+                    {
+                        bFull[m] = true; 
+                        numFull ++; 
+                    }
+                }
+            }
+        }
+    }
+
+    m_nTotalWindows = totalWindows; 
+    for (int m=0; m<m_nNumModels; m++) 
+    {
+        m_Workspaces[m].m_nTotalWindows = totalWindows; 
+#if defined(COUNT_PRUNE_EFFECT)
+        m_pModels[m]->AddPruneCount(m_Workspaces[m].m_pnPruneCount); 
+#endif
+        m_pModels[m]->MergeRawDetRect(&m_Workspaces[m]); 
+    }
+}
+
+int MULTIDETECTOR::GetDetResults(int model, SCORED_RECT **ppRc, bool merged)
+{
+    if (model < 0 || model >= m_nNumModels) 
+        throw "Invalid model"; 
+    return m_Workspaces[model].GetDetResults(ppRc, merged); 
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+/******************************************************************************\
+*
+*   MULTIDETECTOR
+*
+*       Runs several cascades (frontal and profile models, two versions of 
+*       one model, ...) over the same integral image in a single scan. The 
+*       window grid is walked once, the norm of each window is computed once 
+*       and handed to every cascade, and the leading classifiers that all 
+*       models have in common are evaluated once per window: when they reject 
+*       the window, none of the models looks at it again. 
+*
+*       The models must scan the same window grid, that is they need the same 
+*       base window size, stepSize and stepScale. Each model keeps its own 
+*       final threshold and gets its own raw and merged result lists. 
+*
+*       Every window of the grid runs the full cascade of each model: the 
+*       per-model scan settings of DETECTOR (skin gate and masks, truncation, 
+*       prefilter, dense stages, shared lookups, adaptive step and tile 
+*       cache) are ignored here. 
+*
+*       Detectors derived with a cascade transform fit in as well, e.g. the 
+*       four rotations of a square window model find faces in any of the four 
+*       orientations with a single integral image and no pixel rotation: 
+*
+*           DETECTOR up("frontal.txt"); 
+*           DETECTOR right(&up, CASCADE_ROTATE_90), down(&up, CASCADE_ROTATE_180), 
+*                    left(&up, CASCADE_ROTATE_270); 
+*           // add all four, GetRotation(model) tells the orientation of each list 
+*
+*       Typical use:
+*
+*           DETECTOR frontal("frontal.txt"), profile("profile.txt"); 
+*           MULTIDETECTOR multi; 
+*           multi.AddModel(&frontal); 
+*           multi.AddModel(&profile); 
+*           multi.DetectObject(&iimage); 
+*           num = multi.GetDetResults(1, &pRc, true);   // profile faces 
+*
+*       The detectors are not owned and must outlive the MULTIDETECTOR. 
+*
+\******************************************************************************/
+
+#include "detector.h"
+
+#define MAX_NUM_MODELS                      8
+
+class MULTIDETECTOR
+{
+    DETECTOR      * m_pModels[MAX_NUM_MODELS]; 
+    DETWORKSPACE    m_Workspaces[MAX_NUM_MODELS];   // result lists of each model 
+    int             m_nNumModels; 
+    int             m_nSharedStages;                // leading classifiers identical in all models 
+    int             m_nTotalWindows; 
+
+    static bool     SameClassifier(CLASSIFIER *pC1, CLASSIFIER *pC2); 
+
+public: 
+    MULTIDETECTOR(); 
+
+    // returns the index of the model in the result calls 
+    int             AddModel(DETECTOR *pDetector); 
+    int             GetNumModels() { return m_nNumModels; }; 
+    int             GetSharedStages() { return m_nSharedStages; }; 
+
+    void            DetectObject(IN_IMAGE *pIImg, int minScale=0, int maxScale=MAX_NUM_SCALE-1); 
+    int             GetDetResults(int model, SCORED_RECT **ppRc, bool merged); 
+    // orientation of the faces in a model's results, clockwise in degrees 
+    int             GetRotation(int model) { return m_pModels[model]->GetRotation(); }; 
+    int             GetTotalWindows() { return m_nTotalWindows; }; 
+}; 
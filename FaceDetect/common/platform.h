@@ -0,0 +1,111 @@
+#pragma once
+
+/******************************************************************************\
+*
+*   Platform abstraction
+*
+*       On Windows this simply pulls in <windows.h>. Everywhere else it supplies
+*       the handful of Win32 types, macros and CRT helpers used by the detector
+*       and the training tools, so the same sources build with gcc/clang.
+*
+\******************************************************************************/
+
+// SSE2 is part of every x64 target and of x86 builds with /arch:SSE2 or -msse2 
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_WIN32)
+
+#include <windows.h>
+#include <malloc.h>
+
+#define PATH_SEPARATOR          '\\'
+#define PATH_SEPARATOR_STR      "\\"
+
+#else   // !_WIN32
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <limits.h>
+#include <algorithm>
+
+typedef unsigned char           BYTE;
+typedef unsigned short          WORD;
+typedef uint32_t                DWORD;
+typedef int32_t                 LONG;
+typedef unsigned int            UINT;
+typedef int                     BOOL;
+typedef int32_t                 HRESULT;
+typedef long long               LONGLONG;
+#define __int64                 long long
+
+#ifndef TRUE
+#define TRUE                    1
+#endif
+#ifndef FALSE
+#define FALSE                   0
+#endif
+
+#define S_OK                    ((HRESULT)0L)
+#define NOERROR                 0
+#define E_FAIL                  ((HRESULT)0x80004005L)
+#define E_POINTER               ((HRESULT)0x80004003L)
+#define E_INVALIDARG            ((HRESULT)0x80070057L)
+#define E_OUTOFMEMORY           ((HRESULT)0x8007000EL)
+#define SUCCEEDED(hr)           (((HRESULT)(hr)) >= 0)
+#define FAILED(hr)              (((HRESULT)(hr)) < 0)
+
+#ifndef MAX_PATH
+#define MAX_PATH                4096
+#endif
+
+#define PATH_SEPARATOR          '/'
+#define PATH_SEPARATOR_STR      "/"
+
+// windows.h provides max/min as macros, here we use the STL templates instead
+using std::max;
+using std::min;
+
+inline int _stricmp(const char *s1, const char *s2) { return strcasecmp(s1, s2); }
+
+inline void * _aligned_malloc(size_t size, size_t alignment)
+{
+    void *p = NULL;
+    if (posix_memalign(&p, alignment, size) != 0)
+        return NULL;
+    return p;
+}
+inline void _aligned_free(void *p) { free(p); }
+
+// BMP file structures, packed exactly as in wingdi.h
+#pragma pack(push, 2)
+typedef struct tagBITMAPFILEHEADER
+{
+    WORD    bfType;
+    DWORD   bfSize;
+    WORD    bfReserved1;
+    WORD    bfReserved2;
+    DWORD   bfOffBits;
+} BITMAPFILEHEADER;
+#pragma pack(pop)
+
+typedef struct tagBITMAPINFOHEADER
+{
+    DWORD   biSize;
+    LONG    biWidth;
+    LONG    biHeight;
+    WORD    biPlanes;
+    WORD    biBitCount;
+    DWORD   biCompression;
+    DWORD   biSizeImage;
+    LONG    biXPelsPerMeter;
+    LONG    biYPelsPerMeter;
+    DWORD   biClrUsed;
+    DWORD   biClrImportant;
+} BITMAPINFOHEADER;
+
+#endif  // _WIN32
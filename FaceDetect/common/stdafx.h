@@ -5,9 +5,14 @@
 
 #pragma once
 
+// must come before the first system header, any of them may pull in sys/types.h
+#if !defined(_WIN32) && !defined(_FILE_OFFSET_BITS)
+#define _FILE_OFFSET_BITS       64      // 64-bit off_t for the large score files
+#endif
+
 #include <iostream>
-#include <windows.h>
-#include <ASSERT.h>
+#include "platform.h"
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -0,0 +1,208 @@
+/******************************************************************************\
+*
+*   Member functions for the THREADPOOL class
+*
+\******************************************************************************/
+
+#include "stdafx.h"
+#include "threadpool.h"
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+int THREADPOOL::GetNumProcessors()
+{
+#if defined(_WIN32)
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    int num = (int)si.dwNumberOfProcessors;
+#else
+    int num = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return (num > 0) ? num : 1;
+}
+
+THREADPOOL::THREADPOOL(int numThreads) :
+    m_nNumThreads(numThreads > 0 ? numThreads : GetNumProcessors()),
+    m_pProc(NULL),
+    m_pParams(NULL),
+    m_nParamSize(0),
+    m_nNumTasks(0),
+    m_nNextTask(0),
+    m_nPending(0),
+    m_bQuit(false)
+{
+    InitThreadLock(&m_Lock);
+#if defined(_WIN32)
+    m_hWorkSem = CreateSemaphore(NULL, 0, MAXLONG, NULL);
+    m_hDoneEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (m_hWorkSem == NULL || m_hDoneEvent == NULL)
+    {
+        if (m_hWorkSem) CloseHandle(m_hWorkSem);
+        if (m_hDoneEvent) CloseHandle(m_hDoneEvent);
+        DeleteThreadLock(&m_Lock);
+        throw "Thread pool creation failed";
+    }
+
+    m_phThreads = new HANDLE [m_nNumThreads];
+    for (int i=0; i<m_nNumThreads; i++)
+    {
+        DWORD dwThreadId;
+        m_phThreads[i] = CreateThread(NULL, 0, WorkerThreadProc, this, 0, &dwThreadId);
+        if (m_phThreads[i] == NULL)
+        {
+            // the threads already running are stopped and joined, no destructor will run
+            m_nNumThreads = i;
+            Shutdown();
+            throw "Thread creation failed";
+        }
+    }
+#else
+    pthread_cond_init(&m_WorkCond, NULL);
+    pthread_cond_init(&m_DoneCond, NULL);
+
+    m_pThreads = new pthread_t [m_nNumThreads];
+    for (int i=0; i<m_nNumThreads; i++)
+    {
+        if (pthread_create(&m_pThreads[i], NULL, WorkerThreadProc, this) != 0)
+        {
+            m_nNumThreads = i;
+            Shutdown();
+            throw "Thread creation failed";
+        }
+    }
+#endif
+}
+
+THREADPOOL::~THREADPOOL()
+{
+    Shutdown();
+}
+
+// stop and join the m_nNumThreads threads running and free the sync objects
+void THREADPOOL::Shutdown()
+{
+    Lock();
+    m_bQuit = true;
+    Unlock();
+
+#if defined(_WIN32)
+    ReleaseSemaphore(m_hWorkSem, max(m_nNumThreads, 1), NULL);
+    // one wait takes at most MAXIMUM_WAIT_OBJECTS handles
+    for (int i=0; i<m_nNumThreads; i+=MAXIMUM_WAIT_OBJECTS)
+        WaitForMultipleObjects(min(m_nNumThreads-i, MAXIMUM_WAIT_OBJECTS), m_phThreads+i, TRUE, INFINITE);
+    for (int i=0; i<m_nNumThreads; i++)
+        CloseHandle(m_phThreads[i]);
+    delete []m_phThreads;
+    CloseHandle(m_hWorkSem);
+    CloseHandle(m_hDoneEvent);
+#else
+    pthread_cond_broadcast(&m_WorkCond);
+    for (int i=0; i<m_nNumThreads; i++)
+        pthread_join(m_pThreads[i], NULL);
+    delete []m_pThreads;
+    pthread_cond_destroy(&m_WorkCond);
+    pthread_cond_destroy(&m_DoneCond);
+#endif
+    DeleteThreadLock(&m_Lock);
+}
+
+void THREADPOOL::Lock()
+{
+    EnterThreadLock(&m_Lock);
+}
+
+void THREADPOOL::Unlock()
+{
+    LeaveThreadLock(&m_Lock);
+}
+
+void THREADPOOL::Run(TASKPROC pProc, void *pParams, int paramSize, int numTasks)
+{
+    if (numTasks <= 0)
+        return;
+
+    Lock();
+    m_pProc = pProc;
+    m_pParams = (char *)pParams;
+    m_nParamSize = paramSize;
+    m_nNumTasks = numTasks;
+    m_nNextTask = 0;
+    m_nPending = numTasks;
+
+#if defined(_WIN32)
+    Unlock();
+    ReleaseSemaphore(m_hWorkSem, min(numTasks, m_nNumThreads), NULL);
+    Lock();
+    while (m_nPending > 0)
+    {
+        Unlock();
+        WaitForSingleObject(m_hDoneEvent, INFINITE);
+        Lock();
+    }
+#else
+    pthread_cond_broadcast(&m_WorkCond);
+    while (m_nPending > 0)
+        pthread_cond_wait(&m_DoneCond, &m_Lock);
+#endif
+
+    m_pProc = NULL;
+    m_pParams = NULL;
+    Unlock();
+}
+
+void THREADPOOL::WorkerLoop()
+{
+    for (;;)
+    {
+        Lock();
+        while (!m_bQuit && m_nNextTask >= m_nNumTasks)
+        {
+#if defined(_WIN32)
+            // a stale semaphore count only causes one extra trip around this loop
+            Unlock();
+            WaitForSingleObject(m_hWorkSem, INFINITE);
+            Lock();
+#else
+            pthread_cond_wait(&m_WorkCond, &m_Lock);
+#endif
+        }
+        if (m_bQuit)
+        {
+            Unlock();
+            break;
+        }
+        TASKPROC pProc = m_pProc;
+        void *pParam = m_pParams + (size_t)m_nNextTask*m_nParamSize;
+        m_nNextTask ++;
+        Unlock();
+
+        pProc(pParam);
+
+        Lock();
+        if (--m_nPending == 0)
+        {
+#if defined(_WIN32)
+            SetEvent(m_hDoneEvent);
+#else
+            pthread_cond_signal(&m_DoneCond);
+#endif
+        }
+        Unlock();
+    }
+}
+
+#if defined(_WIN32)
+DWORD WINAPI THREADPOOL::WorkerThreadProc(LPVOID lpParam)
+{
+    ((THREADPOOL *)lpParam)->WorkerLoop();
+    return 0;
+}
+#else
+void * THREADPOOL::WorkerThreadProc(void *lpParam)
+{
+    ((THREADPOOL *)lpParam)->WorkerLoop();
+    return NULL;
+}
+#endif
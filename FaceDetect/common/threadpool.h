@@ -0,0 +1,108 @@
+#pragma once
+
+/******************************************************************************\
+*
+*   A small fixed-size thread pool
+*
+*       Worker threads are created once and kept alive for the lifetime of the
+*       pool. Run() hands out numTask tasks (one parameter block each) to the
+*       workers and returns when all of them are finished. Win32 threads are
+*       used on Windows and pthreads everywhere else.
+*
+\******************************************************************************/
+
+#include "platform.h"
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+// a mutex: a critical section on Windows, a pthread mutex everywhere else
+#if defined(_WIN32)
+typedef CRITICAL_SECTION    THREADLOCK;
+#else
+typedef pthread_mutex_t     THREADLOCK;
+#endif
+
+inline void InitThreadLock(THREADLOCK *pLock)
+{
+#if defined(_WIN32)
+    InitializeCriticalSection(pLock);
+#else
+    pthread_mutex_init(pLock, NULL);
+#endif
+}
+
+inline void DeleteThreadLock(THREADLOCK *pLock)
+{
+#if defined(_WIN32)
+    DeleteCriticalSection(pLock);
+#else
+    pthread_mutex_destroy(pLock);
+#endif
+}
+
+inline void EnterThreadLock(THREADLOCK *pLock)
+{
+#if defined(_WIN32)
+    EnterCriticalSection(pLock);
+#else
+    pthread_mutex_lock(pLock);
+#endif
+}
+
+inline void LeaveThreadLock(THREADLOCK *pLock)
+{
+#if defined(_WIN32)
+    LeaveCriticalSection(pLock);
+#else
+    pthread_mutex_unlock(pLock);
+#endif
+}
+
+typedef void (*TASKPROC)(void *pParam);
+
+class THREADPOOL
+{
+    int             m_nNumThreads;
+#if defined(_WIN32)
+    HANDLE        * m_phThreads;
+    HANDLE          m_hWorkSem;     // released once per worker for every batch of tasks
+    HANDLE          m_hDoneEvent;   // set when the last task of a batch is finished
+#else
+    pthread_t     * m_pThreads;
+    pthread_cond_t  m_WorkCond;
+    pthread_cond_t  m_DoneCond;
+#endif
+    THREADLOCK      m_Lock;
+
+    // current batch, protected by m_Lock
+    TASKPROC        m_pProc;
+    char          * m_pParams;
+    int             m_nParamSize;
+    int             m_nNumTasks;
+    int             m_nNextTask;
+    int             m_nPending;
+    bool            m_bQuit;
+
+    void            Lock();
+    void            Unlock();
+    void            Shutdown();
+    void            WorkerLoop();
+
+#if defined(_WIN32)
+    static DWORD WINAPI WorkerThreadProc(LPVOID lpParam);
+#else
+    static void *   WorkerThreadProc(void *lpParam);
+#endif
+
+public:
+    THREADPOOL(int numThreads = 0);     // 0: one thread per processor
+    ~THREADPOOL();
+
+    // run task i on (char *)pParams + i*paramSize for i in [0, numTasks), blocks until all are done
+    void            Run(TASKPROC pProc, void *pParams, int paramSize, int numTasks);
+
+    int             GetNumThreads() { return m_nNumThreads; };
+    static int      GetNumProcessors();
+};
@@ -6,10 +6,10 @@
 *
 \******************************************************************************/
 
-#include <windows.h>
+#include "platform.h"
 #include <math.h>
 #include <iostream>
-#include <ASSERT.h> 
+#include <assert.h> 
 
 #ifndef ASSERT
 #ifdef DEBUG
@@ -0,0 +1,27 @@
+#!/bin/sh
+#
+# Builds libfacedet.so with gcc or clang. Only the detection sources are
+# needed, libjpeg is not linked since the caller hands over decoded pixels.
+#
+#   ./build.sh [output directory]
+#
+
+OUT=$(cd "${1:-.}" && pwd) || exit 1
+CXX=${CXX:-g++}
+COMMON=../common
+
+cd "$(dirname "$0")" || exit 1
+
+$CXX -O2 -fPIC -fvisibility=hidden -shared \
+    -D_DETECTION_ONLY -D_NO_LIBJPEG -DFACEDET_EXPORTS \
+    -I$COMMON \
+    $COMMON/classifier.cpp \
+    $COMMON/detector.cpp \
+    $COMMON/feature.cpp \
+    $COMMON/image.cpp \
+    $COMMON/rand.cpp \
+    $COMMON/stdafx.cpp \
+    $COMMON/wrect.cpp \
+    facedet.cpp \
+    -Wl,-soname,libfacedet.so.1 \
+    -o "$OUT/libfacedet.so"
@@ -0,0 +1,229 @@
+/******************************************************************************\
+*
+*   C interface to the face detector, see facedet.h
+*
+\******************************************************************************/
+
+#include "stdafx.h"
+#include <new>
+#include "detector.h"
+#include "facedet.h"
+
+struct facedet_detector
+{
+    DETECTOR   *m_pDetector;
+    IN_IMAGE    m_IImage;           // reused across calls, only grows
+    int         m_nMinFace;
+    int         m_nMaxFace;
+    const char *m_szLastError;
+};
+
+static int SetError(facedet_detector *pFD, int err, const char *szMsg)
+{
+    if (pFD)
+        pFD->m_szLastError = szMsg;
+    return err;
+}
+
+// map the face size range to the range of scale indices scanned by DETECTOR::DetectObject
+static void GetScaleRange(facedet_detector *pFD, int width, int height, int *pMinScale, int *pMaxScale)
+{
+    DETECTOR *pDetector = pFD->m_pDetector;
+    int minScale = 0;
+    while (minScale < MAX_NUM_SCALE-1 && pFD->m_nMinFace > 0 &&
+           pDetector->GetWindowWidth(minScale) < pFD->m_nMinFace)
+        minScale ++;
+
+    int maxScale = minScale;
+    while (maxScale < MAX_NUM_SCALE-1 &&
+           pDetector->GetWindowWidth(maxScale+1) <= width &&
+           pDetector->GetWindowHeight(maxScale+1) <= height &&
+           (pFD->m_nMaxFace <= 0 || pDetector->GetWindowWidth(maxScale+1) <= pFD->m_nMaxFace))
+        maxScale ++;
+
+    *pMinScale = minScale;
+    *pMaxScale = maxScale;
+}
+
+int facedet_version(void)
+{
+    return FACEDET_API_VERSION;
+}
+
+int facedet_create(const char *model_file, float step_size, float step_scale, facedet_detector **detector)
+{
+    if (detector == NULL)
+        return FACEDET_E_INVALIDARG;
+    *detector = NULL;
+    if (model_file == NULL)
+        return FACEDET_E_INVALIDARG;
+    if (step_size <= 0.0f)
+        step_size = 0.1f;
+    if (step_scale <= 0.0f)
+        step_scale = 1.25f;
+    if (step_scale <= 1.0f)
+        return FACEDET_E_INVALIDARG;
+
+    facedet_detector *pFD = new (std::nothrow) facedet_detector;
+    if (pFD == NULL)
+        return FACEDET_E_NOMEM;
+    pFD->m_pDetector = NULL;
+    pFD->m_nMinFace = 0;
+    pFD->m_nMaxFace = 0;
+    pFD->m_szLastError = "";
+    pFD->m_IImage.SetCompactNorm(true);     // only ComputeNorm() reads the squared integral 
+
+    try
+    {
+        pFD->m_pDetector = new DETECTOR(model_file, step_size, step_scale);
+    }
+    catch (const char *)
+    {
+        delete pFD;
+        return FACEDET_E_MODEL;
+    }
+    catch (...)
+    {
+        delete pFD;
+        return FACEDET_E_NOMEM;
+    }
+    if (!pFD->m_pDetector->IsValid())
+    {
+        delete pFD->m_pDetector;
+        delete pFD;
+        return FACEDET_E_MODEL;
+    }
+
+    *detector = pFD;
+    return FACEDET_OK;
+}
+
+void facedet_destroy(facedet_detector *detector)
+{
+    if (detector == NULL)
+        return;
+    delete detector->m_pDetector;
+    delete detector;
+}
+
+int facedet_set_face_size(facedet_detector *detector, int min_face, int max_face)
+{
+    if (detector == NULL || min_face < 0 || max_face < 0 || (max_face > 0 && max_face < min_face))
+        return SetError(detector, FACEDET_E_INVALIDARG, "invalid face size range");
+    detector->m_nMinFace = min_face;
+    detector->m_nMaxFace = max_face;
+    return FACEDET_OK;
+}
+
+int facedet_set_threshold(facedet_detector *detector, float threshold)
+{
+    if (detector == NULL)
+        return FACEDET_E_INVALIDARG;
+    // the threshold of the cut in effect, the whole cascade's unless facedet_set_num_stages cut it
+    DETECTOR *pDetector = detector->m_pDetector;
+    int numStages = pDetector->GetNumStages();
+    if (numStages <= 0 || numStages > pDetector->GetNumClassifiers())
+        numStages = pDetector->GetNumClassifiers();
+    pDetector->SetTruncScoreTh(numStages, threshold);
+    return FACEDET_OK;
+}
+
+float facedet_get_threshold(const facedet_detector *detector)
+{
+    if (detector == NULL)
+        return 0.0f;
+    return detector->m_pDetector->GetTruncScoreTh(detector->m_pDetector->GetNumStages());
+}
+
+int facedet_set_skin_gate(facedet_detector *detector, float min_fraction)
+{
+    if (detector == NULL || min_fraction < 0.0f || min_fraction > 1.0f)
+        return SetError(detector, FACEDET_E_INVALIDARG, "skin fraction out of range");
+    detector->m_pDetector->SetSkinGate(min_fraction);
+    return FACEDET_OK;
+}
+
+int facedet_set_num_stages(facedet_detector *detector, int num_stages)
+{
+    if (detector == NULL || num_stages < 0)
+        return SetError(detector, FACEDET_E_INVALIDARG, "number of stages out of range");
+    detector->m_pDetector->SetNumStages(num_stages);
+    return FACEDET_OK;
+}
+
+int facedet_detect(facedet_detector *detector,
+                   const unsigned char *pixels, int width, int height, int stride,
+                   int pixel_format,
+                   facedet_face *faces, int max_faces, int *num_faces)
+{
+    if (num_faces)
+        *num_faces = 0;
+    if (detector == NULL)
+        return FACEDET_E_INVALIDARG;
+    if (pixels == NULL || num_faces == NULL || width <= 0 || height <= 0 ||
+        max_faces < 0 || (faces == NULL && max_faces > 0))
+        return SetError(detector, FACEDET_E_INVALIDARG, "invalid argument");
+
+    PIXEL_FORMAT format;
+    int bpp;
+    switch (pixel_format)
+    {
+    case FACEDET_PIXFMT_GRAY8:
+    case FACEDET_PIXFMT_NV12:
+    case FACEDET_PIXFMT_I420:   format = PIXFMT_GRAY8;  bpp = 1; break;
+    case FACEDET_PIXFMT_RGB24:  format = PIXFMT_RGB24;  bpp = 3; break;
+    case FACEDET_PIXFMT_BGR24:  format = PIXFMT_BGR24;  bpp = 3; break;
+    case FACEDET_PIXFMT_BGRA32: format = PIXFMT_BGRA32; bpp = 4; break;
+    case FACEDET_PIXFMT_RGBA32: format = PIXFMT_RGBA32; bpp = 4; break;
+    case FACEDET_PIXFMT_YUYV:   format = PIXFMT_YUYV;   bpp = 2; break;
+    default:
+        return SetError(detector, FACEDET_E_INVALIDARG, "unknown pixel format");
+    }
+    if (stride < width*bpp)
+        return SetError(detector, FACEDET_E_INVALIDARG, "stride smaller than a row of pixels");
+
+    DETECTOR *pDetector = detector->m_pDetector;
+    if (width < pDetector->GetWindowWidth(0) || height < pDetector->GetWindowHeight(0))
+        return FACEDET_OK;      // too small to hold even the smallest face
+
+    try
+    {
+        int minScale, maxScale;
+        GetScaleRange(detector, width, height, &minScale, &maxScale);
+        if (detector->m_nMaxFace > 0 && pDetector->GetWindowWidth(minScale) > detector->m_nMaxFace)
+            return FACEDET_OK;
+
+        detector->m_IImage.Init(pixels, width, height, stride, format);
+        if (pDetector->GetSkinGate() > 0.0f)
+            pDetector->SetSkinMask(pixels, width, height, stride, format);
+        pDetector->DetectObject(&detector->m_IImage, minScale, maxScale);
+
+        SCORED_RECT *pRc;
+        int num = pDetector->GetDetResults(&pRc, true);
+        for (int i=0; i<num && i<max_faces; i++)
+        {
+            faces[i].x = pRc[i].m_rect.m_ixMin;
+            faces[i].y = pRc[i].m_rect.m_iyMin;
+            faces[i].width = pRc[i].m_rect.m_ixMax - pRc[i].m_rect.m_ixMin;
+            faces[i].height = pRc[i].m_rect.m_iyMax - pRc[i].m_rect.m_iyMin;
+            faces[i].score = pRc[i].m_score;
+        }
+        *num_faces = num;
+    }
+    catch (const char *szMsg)
+    {
+        return SetError(detector, FACEDET_E_FAILED, szMsg);
+    }
+    catch (...)
+    {
+        return SetError(detector, FACEDET_E_NOMEM, "out of memory");
+    }
+    return FACEDET_OK;
+}
+
+const char *facedet_last_error(const facedet_detector *detector)
+{
+    if (detector == NULL)
+        return "invalid handle";
+    return detector->m_szLastError;
+}
@@ -0,0 +1,117 @@
+/******************************************************************************\
+*
+*   facedet.h
+*
+*       Plain C interface to the face detector, built as a shared library
+*       (libfacedet.so / facedet.dll). Only C types cross this boundary so the
+*       library can be loaded from Go (cgo), Rust (FFI), Python (ctypes/cffi)
+*       and the like without any marshaling layer.
+*
+*       Pixels are read in place from the caller's buffer, no copy of the image
+*       is made. The integral image and the result buffers are kept inside the
+*       handle and reused across calls, so a handle must not be used by two
+*       threads at the same time. Create one handle per worker thread instead.
+*
+*       All functions returning int return FACEDET_OK or a negative error code.
+*       No C++ exception ever leaves the library.
+*
+\******************************************************************************/
+
+#ifndef _FACEDET_H_
+#define _FACEDET_H_
+
+#if defined(_WIN32)
+#if defined(FACEDET_EXPORTS)
+#define FACEDET_API __declspec(dllexport)
+#else
+#define FACEDET_API __declspec(dllimport)
+#endif
+#else
+#define FACEDET_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FACEDET_API_VERSION         1
+
+/* return codes */
+#define FACEDET_OK                  0
+#define FACEDET_E_INVALIDARG        (-1)
+#define FACEDET_E_MODEL             (-2)    /* model file missing or corrupt */
+#define FACEDET_E_NOMEM             (-3)
+#define FACEDET_E_FAILED            (-4)    /* any other failure, see facedet_last_error */
+
+/* pixel formats, 8 bits per channel, rows are stride bytes apart */
+#define FACEDET_PIXFMT_GRAY8        0
+#define FACEDET_PIXFMT_RGB24        1
+#define FACEDET_PIXFMT_BGR24        2
+#define FACEDET_PIXFMT_BGRA32       3
+#define FACEDET_PIXFMT_RGBA32       4
+#define FACEDET_PIXFMT_NV12         5       /* only the Y plane is read, pass its pointer and stride */
+#define FACEDET_PIXFMT_I420         6       /* only the Y plane is read, pass its pointer and stride */
+#define FACEDET_PIXFMT_YUYV         7       /* packed 4:2:2, Y0 U Y1 V */
+
+typedef struct facedet_detector facedet_detector;
+
+typedef struct facedet_face
+{
+    int     x;              /* left, in pixels of the input buffer */
+    int     y;              /* top */
+    int     width;
+    int     height;
+    float   score;          /* detector confidence, larger is more likely a face: the cascade
+                               score of the best window merged into this face */
+} facedet_face;
+
+/* version of the interface the library was built with, compare to FACEDET_API_VERSION */
+FACEDET_API int         facedet_version(void);
+
+/* load a model (e.g. data/classifier.txt). step_size and step_scale <= 0 select the defaults 0.1 and 1.25 */
+FACEDET_API int         facedet_create(const char *model_file, float step_size, float step_scale,
+                                       facedet_detector **detector);
+FACEDET_API void        facedet_destroy(facedet_detector *detector);
+
+/* only windows with min_face <= side <= max_face are scanned, 0 means no limit */
+FACEDET_API int         facedet_set_face_size(facedet_detector *detector, int min_face, int max_face);
+
+/* final score threshold of the cascade as cut by facedet_set_num_stages, the model file
+   supplies the default. set it after choosing the cut */
+FACEDET_API int         facedet_set_threshold(facedet_detector *detector, float threshold);
+FACEDET_API float       facedet_get_threshold(const facedet_detector *detector);
+
+/*
+ *  Skin gate for color input: windows with less than min_fraction (0 to 1) of skin
+ *  colored pixels are not scanned. Faster on photos with little skin, but faces in
+ *  odd lighting may be lost. Gray formats are never gated. 0, the default, turns it off.
+ */
+FACEDET_API int         facedet_set_skin_gate(facedet_detector *detector, float min_fraction);
+
+/*
+ *  Speed/quality knob: evaluate only the first num_stages classifiers of the cascade,
+ *  with the final threshold the model file calibrates for that cut (see
+ *  FaceDetTestROC -calibrate). A cut without a calibrated threshold uses the one of
+ *  the whole cascade. 0, the default, runs the whole cascade.
+ */
+FACEDET_API int         facedet_set_num_stages(facedet_detector *detector, int num_stages);
+
+/*
+ *  Detect faces in a caller-owned buffer. Up to max_faces merged detections are
+ *  written to faces. *num_faces receives the total number found, which may be
+ *  larger than max_faces; call again with a bigger array if all are needed.
+ *  faces may be NULL when max_faces is 0.
+ */
+FACEDET_API int         facedet_detect(facedet_detector *detector,
+                                       const unsigned char *pixels, int width, int height, int stride,
+                                       int pixel_format,
+                                       facedet_face *faces, int max_faces, int *num_faces);
+
+/* message for the last failure on this handle, never NULL */
+FACEDET_API const char *facedet_last_error(const facedet_detector *detector);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* _FACEDET_H_ */